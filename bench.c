@@ -0,0 +1,237 @@
+/* Evaluator benchmark for simavr.
+Build with "make BENCH=1" and run with "make bench-run", or build and
+run every evaluator variant with "make bench-matrix". Each term is
+prepared once and solved for BENCH_RUNS * BENCH_X_COUNT different
+values of x, so with CALC_CACHE_SIZE every call is a miss that fills
+the cache, and the hits are timed on their own line. The average
+number of cycles per calc_solve call (and per dec_solve call for terms
+the decimal engine handles, which includes formatting the result) is
+written to USART0, which simavr prints.
+The derivative by calc_solve_dual is compared to the two calc_solve
+calls of a difference quotient.
+With CALC_Y2 the last term evaluates the first two as Y1 and Y2 in one
+pass, to compare with their sum. */
+
+#define BENCH_RUNS              8
+#define BENCH_X_COUNT          16
+
+/* The terms as they are stored in buf_term: a function is its token
+type, which opens the bracket, and the division sign is CHAR_DIV. They
+are built from these constants, so they follow enum TOKEN_TYPE. */
+#define BENCH_POLY  'x', '*', 'x', '*', 'x', '-', '2', '*', 'x', '*', 'x', \
+	'+', '3', '*', 'x', '-', '4'
+#define BENCH_TRIG  TT_SIN, 'x', ')', '*', TT_SIN, 'x', ')', '+', \
+	TT_COS, 'x', ')', '*', TT_COS, 'x', ')'
+
+static const uint8_t _bench_poly[] PROGMEM = { BENCH_POLY, 0 };
+static const uint8_t _bench_trig[] PROGMEM = { BENCH_TRIG, 0 };
+static const uint8_t _bench_log[] PROGMEM =
+{
+	TT_LOG, 'x', '+', '1', ')', CHAR_DIV, '(', 'x', '+', '1', ')', 0
+};
+static const uint8_t _bench_pow[] PROGMEM = "x^1.5+x^3";
+static const uint8_t _bench_sqrt[] PROGMEM =
+{
+	'x', '^', '0', '.', '5', '+', TT_EXP, '-', 'x', ')', 0
+};
+static const uint8_t _bench_dec[] PROGMEM =
+{
+	'1', '.', '2', '5', '*', '3', '.', '5', '-', '0', '.', '1', '+',
+	'0', '.', '2', CHAR_DIV, '3', 0
+};
+#if CALC_Y2
+static const uint8_t _bench_y2[] PROGMEM =
+{
+	BENCH_POLY, CHAR_SEP, BENCH_TRIG, 0
+};
+#endif
+
+static const uint8_t *const _bench_terms[] PROGMEM =
+{
+	_bench_poly,
+	_bench_trig,
+	_bench_log,
+	_bench_pow,
+	_bench_sqrt,
+	_bench_dec,
+#if CALC_Y2
+	_bench_y2,
+#endif
+};
+
+static volatile uint16_t bench_ovf;
+
+static void bench_chr(uint8_t c);
+static void bench_str_P(const uint8_t *s);
+static void bench_num(uint32_t n);
+static void bench_start(void);
+static uint32_t bench_stop(void);
+static void bench_result(const uint8_t *term, const uint8_t *engine,
+	uint32_t cycles);
+static void bench(void);
+
+ISR(TIMER1_OVF_vect)
+{
+	++bench_ovf;
+}
+
+static void bench_chr(uint8_t c)
+{
+	while(!(UCSR0A & (1 << UDRE0))) ;
+	UDR0 = c;
+}
+
+static void bench_str_P(const uint8_t *s)
+{
+	register uint8_t c;
+	for(; (c = pgm_read_byte(s)); ++s)
+	{
+		bench_chr(c);
+	}
+}
+
+static void bench_num(uint32_t n)
+{
+	uint8_t *s;
+	s = (uint8_t *)ultoa(n, (char *)_buf_conv, 10);
+	for(; *s; ++s)
+	{
+		bench_chr(*s);
+	}
+}
+
+static void bench_start(void)
+{
+	bench_ovf = 0;
+	TCNT1 = 0;
+	TCCR1B = (1 << CS10);
+}
+
+static uint32_t bench_stop(void)
+{
+	TCCR1B = 0;
+	if(TIFR1 & (1 << TOV1))
+	{
+		TIFR1 = (1 << TOV1);
+		++bench_ovf;
+	}
+
+	return ((uint32_t)bench_ovf << 16) | TCNT1;
+}
+
+static void bench_result(const uint8_t *term, const uint8_t *engine,
+	uint32_t cycles)
+{
+	/* The term as it is shown on the display */
+	uint8_t c, k;
+	for(; (c = pgm_read_byte(term)); ++term)
+	{
+		for(k = 0; k < field_chr_width(c); ++k)
+		{
+			bench_chr(field_chr(c, k));
+		}
+	}
+
+	bench_str_P(engine);
+	bench_num(cycles / (BENCH_RUNS * BENCH_X_COUNT));
+	bench_chr('\n');
+}
+
+static void bench(void)
+{
+	uint8_t i, j, k;
+	const uint8_t *term;
+	num_t y[CALC_FUNCS];
+#if CALC_DUAL
+	num_t dy[CALC_FUNCS];
+#endif
+
+	UCSR0B = (1 << TXEN0);
+	TIMSK2 = 0;
+	TIMSK1 = (1 << TOIE1);
+	sei();
+
+	for(i = 0; i < sizeof(_bench_terms) / sizeof(*_bench_terms); ++i)
+	{
+		term = (const uint8_t *)pgm_read_word(_bench_terms + i);
+		strcpy_P((char *)buf_term, (const char *)term);
+		calc_prepare(buf_term);
+
+		bench_start();
+		for(j = 0; j < BENCH_RUNS; ++j)
+		{
+			for(k = 1; k <= BENCH_X_COUNT; ++k)
+			{
+				calc_solve(j * BENCH_X_COUNT + k, y);
+			}
+		}
+
+		bench_result(term, (const uint8_t *)PSTR(" (num_t): "),
+			bench_stop());
+
+#if CALC_CACHE_SIZE
+		/* The same x every time, all calls but the first are hits */
+		bench_start();
+		for(j = 0; j < BENCH_RUNS; ++j)
+		{
+			for(k = 1; k <= BENCH_X_COUNT; ++k)
+			{
+				calc_solve(1, y);
+			}
+		}
+
+		bench_result(term, (const uint8_t *)PSTR(" (cache hit): "),
+			bench_stop());
+#endif
+
+#if CALC_DUAL
+		bench_start();
+		for(j = 0; j < BENCH_RUNS; ++j)
+		{
+			for(k = 1; k <= BENCH_X_COUNT; ++k)
+			{
+				calc_solve(j * BENCH_X_COUNT + k, y);
+				calc_solve(j * BENCH_X_COUNT + k + 0.001, dy);
+			}
+		}
+
+		bench_result(term, (const uint8_t *)PSTR(" (2x num_t): "),
+			bench_stop());
+
+		bench_start();
+		for(j = 0; j < BENCH_RUNS; ++j)
+		{
+			for(k = 1; k <= BENCH_X_COUNT; ++k)
+			{
+				calc_solve_dual(j * BENCH_X_COUNT + k, y, dy);
+			}
+		}
+
+		bench_result(term, (const uint8_t *)PSTR(" (dual): "),
+			bench_stop());
+#endif
+
+#if CALC_DECIMAL
+		if(calc_exact)
+		{
+			bench_start();
+			for(j = 0; j < BENCH_RUNS; ++j)
+			{
+				for(k = 1; k <= BENCH_X_COUNT; ++k)
+				{
+					dec_solve(buf_term, _buf_conv, LCD_WIDTH);
+				}
+			}
+
+			bench_result(term, (const uint8_t *)PSTR(" (decimal): "),
+				bench_stop());
+		}
+#endif
+	}
+
+	/* simavr exits when sleeping with interrupts disabled */
+	cli();
+	sleep_enable();
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	sleep_cpu();
+}
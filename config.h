@@ -0,0 +1,160 @@
+/* Build profile dependent sizes.
+The MCU and clock are selected by PROFILE in the Makefile,
+everything that has to fit into SRAM scales with RAMEND. */
+
+#if RAMEND < 0x500
+
+/* 1 KB: ATmega168. 32 tokens hardly fill more than 128 characters,
+a longer term buffer would leave no margin within RAM_BUDGET */
+#define PROFILE_STACK_SIZE     32
+#define OPERATOR_STACK_SIZE    32
+#define TOKEN_LIST_SIZE        32
+#define TERM_MAX_LEN          128
+#define PROFILE_CACHE_SIZE      0
+#define PROFILE_DECIMAL         0
+#define PROFILE_INTERVAL        0
+#define PROFILE_DUAL            0
+#define PROFILE_Y2              0
+#define PROFILE_XY              0
+#define PROFILE_SUM             0
+#define PROFILE_ITER            0
+#define PROFILE_STAT            0
+#define PROFILE_IR              0
+
+#elif RAMEND < 0x900
+
+/* 2 KB: ATmega328P. With every mode on, the sizes are cut so
+.data + .bss stays within RAM_BUDGET, and there is no room for the
+register program (7 bytes per token) */
+#define PROFILE_STACK_SIZE     48
+#define OPERATOR_STACK_SIZE    48
+#define TOKEN_LIST_SIZE        48
+#define TERM_MAX_LEN          384
+#define PROFILE_CACHE_SIZE      8
+#define PROFILE_DECIMAL         1
+#define PROFILE_INTERVAL        1
+#define PROFILE_DUAL            1
+#define PROFILE_Y2              1
+#define PROFILE_XY              1
+#define PROFILE_SUM             1
+#define PROFILE_ITER            1
+#define PROFILE_STAT            1
+#define PROFILE_IR              0
+
+#else
+
+/* 16 KB: ATmega1284P */
+#define PROFILE_STACK_SIZE    128
+#define OPERATOR_STACK_SIZE   128
+#define TOKEN_LIST_SIZE       128
+#define TERM_MAX_LEN         1024
+#define PROFILE_CACHE_SIZE     64
+#define PROFILE_DECIMAL         1
+#define PROFILE_INTERVAL        1
+#define PROFILE_DUAL            1
+#define PROFILE_Y2              1
+#define PROFILE_XY              1
+#define PROFILE_SUM             1
+#define PROFILE_ITER            1
+#define PROFILE_STAT            1
+#define PROFILE_IR              1
+
+#endif
+
+/* Evaluator specialisation, each can be overridden with -D
+(see "make bench-matrix"). calc_solve is compiled for exactly
+one combination, there are no runtime configuration checks.
+	NUMBER_STACK_SIZE: evaluation stack depth
+	CALC_FAST_MATH:    no per operation domain checks, errors are
+	                   detected from a NaN or infinite result only
+	CALC_CACHE_SIZE:   results cached by x, power of two or 0
+	CALC_DOUBLE:       evaluate in 64 bit double, needs -mdouble=64
+	                   which the Makefile adds for CALC_DOUBLE=1
+	CALC_DECIMAL:      exact decimal evaluation of terms without x
+	                   that only use + - * /, DEC_STACK_SIZE deep
+	CALC_INTERVAL:     interval evaluation, used by table mode to
+	                   skip rows when searching for a sign change
+	CALC_DUAL:         derivative by automatic differentiation, shown
+	                   as Y' in table mode
+	CALC_Y2:           a second function after a ';' in the term,
+	                   evaluated in the same pass as the first one
+	CALC_XY:           a second variable y with its own table axis,
+	                   the program is partially evaluated for the
+	                   variable that is not moved
+	CALC_SUM:          sum of the table rows in the background with
+	                   compensated summation, see mode_sum
+	CALC_ITER:         iteration u(n + 1) = f(u(n)) from a table row
+	                   with convergence and cycle detection
+	CALC_STAT:         one variable statistics of entered values or
+	                   table rows, on the mode button
+	CALC_IR:           calc_solve runs a register program lowered from
+	                   the RPN program instead of the stack machine */
+#ifndef NUMBER_STACK_SIZE
+#define NUMBER_STACK_SIZE     PROFILE_STACK_SIZE
+#endif
+
+#ifndef CALC_FAST_MATH
+#define CALC_FAST_MATH         0
+#endif
+
+#ifndef CALC_CACHE_SIZE
+#define CALC_CACHE_SIZE       PROFILE_CACHE_SIZE
+#endif
+
+#ifndef CALC_DOUBLE
+#define CALC_DOUBLE            0
+#endif
+
+#ifndef CALC_DECIMAL
+#define CALC_DECIMAL          PROFILE_DECIMAL
+#endif
+
+#ifndef CALC_INTERVAL
+#define CALC_INTERVAL         PROFILE_INTERVAL
+#endif
+
+#ifndef CALC_DUAL
+#define CALC_DUAL             PROFILE_DUAL
+#endif
+
+#ifndef CALC_Y2
+#define CALC_Y2               PROFILE_Y2
+#endif
+
+#ifndef CALC_XY
+#define CALC_XY               PROFILE_XY
+#endif
+
+#ifndef CALC_SUM
+#define CALC_SUM              PROFILE_SUM
+#endif
+
+#ifndef CALC_ITER
+#define CALC_ITER             PROFILE_ITER
+#endif
+
+#ifndef CALC_STAT
+#define CALC_STAT             PROFILE_STAT
+#endif
+
+#ifndef CALC_IR
+#define CALC_IR               PROFILE_IR
+#endif
+
+#define DEC_STACK_SIZE         16
+
+#if CALC_CACHE_SIZE & (CALC_CACHE_SIZE - 1)
+#error "CALC_CACHE_SIZE must be a power of two"
+#endif
+
+#if NUMBER_STACK_SIZE > 255
+#error "NUMBER_STACK_SIZE must fit into 8 bits"
+#endif
+
+/* Key scanning interrupt frequency, Timer 2 with prescaler 1024 */
+#define KEY_SCAN_HZ           100
+#define KEY_SCAN_OCR          ((F_CPU) / 1024 / (KEY_SCAN_HZ) - 1)
+
+#if KEY_SCAN_OCR > 255
+#error "F_CPU too high for the key scanning timer"
+#endif
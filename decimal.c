@@ -0,0 +1,193 @@
+/* Decimal arithmetic for exact results of the four basic operations.
+A value is m * 10^e with a signed integer coefficient of at most
+DEC_DIGITS digits, so decimal inputs like 0.1 are represented exactly
+and are converted to a string without going through binary floats.
+Sums are exact while they fit into DEC_DIGITS digits. Products and
+quotients like 1/3 are computed in full and rounded once to DEC_DIGITS
+significant digits. */
+
+#define DEC_DIGITS             18
+#define DEC_MAX       1000000000000000000LL
+#define DEC_LIMIT      100000000000000000LL
+#define DEC_EXP_MAX          1000
+
+typedef struct DECIMAL
+{
+	int64_t m;
+	int16_t e;
+} Decimal;
+
+static void dec_shr(Decimal *d);
+static void dec_trim(Decimal *d);
+static uint8_t dec_range(const Decimal *d);
+static uint8_t dec_add(Decimal *a, const Decimal *b);
+static uint8_t dec_mul(Decimal *a, const Decimal *b);
+static uint8_t dec_div(Decimal *a, const Decimal *b);
+
+static void dec_shr(Decimal *d)
+{
+	/* Drop the last digit, rounding half away from zero */
+	int8_t r = d->m % 10;
+	d->m /= 10;
+	if(r >= 5)
+	{
+		++d->m;
+	}
+	else if(r <= -5)
+	{
+		--d->m;
+	}
+
+	++d->e;
+}
+
+static void dec_trim(Decimal *d)
+{
+	/* Remove trailing zeros from the coefficient */
+	if(d->m == 0)
+	{
+		d->e = 0;
+		return;
+	}
+
+	while(d->m % 10 == 0)
+	{
+		d->m /= 10;
+		++d->e;
+	}
+}
+
+static uint8_t dec_range(const Decimal *d)
+{
+	return d->e > -DEC_EXP_MAX && d->e < DEC_EXP_MAX;
+}
+
+static uint8_t dec_add(Decimal *a, const Decimal *b)
+{
+	/* Align the exponents by scaling the coefficient with the
+	larger exponent up, or when that would overflow, by rounding
+	the other one down. */
+	Decimal t = *b, *hi, *lo;
+	if(a->m == 0)
+	{
+		a->e = t.e;
+	}
+	else if(t.m == 0)
+	{
+		t.e = a->e;
+	}
+
+	while(a->e != t.e)
+	{
+		if(a->e > t.e)
+		{
+			hi = a;
+			lo = &t;
+		}
+		else
+		{
+			hi = &t;
+			lo = a;
+		}
+
+		if(hi->m > -DEC_LIMIT && hi->m < DEC_LIMIT)
+		{
+			hi->m *= 10;
+			--hi->e;
+		}
+		else
+		{
+			dec_shr(lo);
+		}
+	}
+
+	a->m += t.m;
+	if(a->m <= -DEC_MAX || a->m >= DEC_MAX)
+	{
+		dec_shr(a);
+	}
+
+	return dec_range(a);
+}
+
+static uint8_t dec_mul(Decimal *a, const Decimal *b)
+{
+	/* The full product of the coefficients in four 32 bit words, most
+	significant first, from the products of their 32 bit halves. It is
+	cut to DEC_DIGITS digits and rounded once from the last dropped
+	digit, the digits below it cannot change rounding half away from
+	zero. */
+	uint64_t x, y, lo, m1, m2, hi;
+	uint32_t p[4];
+	uint8_t neg, i, r;
+	neg = (a->m < 0) != (b->m < 0);
+	x = a->m < 0 ? -a->m : a->m;
+	y = b->m < 0 ? -b->m : b->m;
+	lo = (x & 0xFFFFFFFF) * (y & 0xFFFFFFFF);
+	m1 = (x >> 32) * (y & 0xFFFFFFFF);
+	m2 = (x & 0xFFFFFFFF) * (y >> 32);
+	hi = (x >> 32) * (y >> 32);
+	p[3] = lo;
+	lo = (lo >> 32) + (m1 & 0xFFFFFFFF) + (m2 & 0xFFFFFFFF);
+	p[2] = lo;
+	hi += (m1 >> 32) + (m2 >> 32) + (lo >> 32);
+	p[1] = hi;
+	p[0] = hi >> 32;
+
+	a->e += b->e;
+	for(r = 0; p[0] || p[1] || ((uint64_t)p[2] << 32 | p[3]) >= DEC_MAX;)
+	{
+		/* Divide by 10 from the top, r is the remainder */
+		for(i = 0, lo = 0; i < 4; ++i)
+		{
+			lo = lo << 32 | p[i];
+			p[i] = lo / 10;
+			lo %= 10;
+		}
+
+		r = lo;
+		++a->e;
+	}
+
+	x = (uint64_t)p[2] << 32 | p[3];
+	if(r >= 5 && ++x == DEC_MAX)
+	{
+		x /= 10;
+		++a->e;
+	}
+
+	a->m = neg ? -(int64_t)x : (int64_t)x;
+	dec_trim(a);
+	return dec_range(a);
+}
+
+static uint8_t dec_div(Decimal *a, const Decimal *b)
+{
+	/* Long division by the full divisor, one digit of the quotient
+	per step until it is exact or has DEC_DIGITS digits, then rounded
+	once from the remainder. r < dv < DEC_MAX, so 10 * r fits. */
+	uint64_t n, dv, r;
+	uint8_t neg;
+	neg = (a->m < 0) != (b->m < 0);
+	n = a->m < 0 ? -a->m : a->m;
+	dv = b->m < 0 ? -b->m : b->m;
+	r = n % dv;
+	n /= dv;
+	while(r && n < DEC_LIMIT)
+	{
+		r *= 10;
+		n = n * 10 + r / dv;
+		r %= dv;
+		--a->e;
+	}
+
+	if(r >= dv - r)
+	{
+		++n;
+	}
+
+	a->m = neg ? -(int64_t)n : (int64_t)n;
+	a->e -= b->e;
+	dec_trim(a);
+	return dec_range(a);
+}
@@ -0,0 +1,199 @@
+/* Forward mode automatic differentiation of the RPN program.
+Every stack entry is a dual number, the value and the derivative by x,
+so f(x) and f'(x) come out of one pass instead of two calc_solve calls
+for a difference quotient, which loses most digits of a float. The
+trigonometric functions are in radians, the conversion of the angle
+unit is a multiplication in the program (see calc_convert). */
+
+typedef struct DUAL
+{
+	num_t v, d;
+} Dual;
+
+static uint8_t calc_solve_dual(num_t x, num_t *y, num_t *dy);
+
+static uint8_t calc_solve_dual(num_t x, num_t *y, num_t *dy)
+{
+	/* Same program as calc_solve. The dual stack shares the
+	memory of the number stack, so it holds half as many entries. */
+	Dual *stack = (Dual *)num_stack, *a, *b;
+	num_t t;
+	uint8_t tok_type_i, tok_num_i, top_num, tt;
+#if CALC_Y2
+	uint8_t fail = 0;
+#endif
+	if(calc_depth > NUMBER_STACK_SIZE / 2)
+	{
+		return ERROR_NOMEM;
+	}
+
+	tok_type_i = 0;
+	tok_num_i = 0;
+	top_num = 0;
+	for(; tok_type_i < tok_cnt; ++tok_type_i)
+	{
+		switch((tt = tok_type_list[tok_type_i]))
+		{
+		case TT_NUMBER:
+			a = &stack[top_num++];
+			a->v = tok_num_list[tok_num_i++];
+			a->d = 0;
+			break;
+
+		case TT_X:
+			a = &stack[top_num++];
+			a->v = x;
+			a->d = 1;
+			break;
+
+		default:
+			if(tt >= TT_ADD)
+			{
+				--top_num;
+			}
+
+			a = &stack[top_num - 1];
+			b = &stack[top_num];
+			switch(tt)
+			{
+			case TT_UNARY_MINUS:
+				a->v = -a->v;
+				a->d = -a->d;
+				break;
+
+			case TT_ADD:
+				a->v += b->v;
+				a->d += b->d;
+				break;
+
+			case TT_SUB:
+				a->v -= b->v;
+				a->d -= b->d;
+				break;
+
+			case TT_MUL:
+				a->d = a->d * b->v + a->v * b->d;
+				a->v *= b->v;
+				break;
+
+			case TT_DIV:
+#if !CALC_FAST_MATH
+				if(b->v == 0.0)
+				{
+					/* Division by zero */
+					CALC_DOMAIN_ERROR(tok_type_i);
+				}
+#endif
+
+				a->v /= b->v;
+				a->d = (a->d - a->v * b->d) / b->v;
+				break;
+
+			case TT_LOG:
+				a->d /= a->v;
+				a->v = log(a->v);
+				break;
+
+			case TT_SIN:
+				a->d *= cos(a->v);
+				a->v = sin(a->v);
+				break;
+
+			case TT_COS:
+				a->d *= -sin(a->v);
+				a->v = cos(a->v);
+				break;
+
+			case TT_TAN:
+				t = tan(a->v);
+				a->d *= 1 + t * t;
+				a->v = t;
+				break;
+
+			case TT_ASIN:
+			case TT_ACOS:
+#if !CALC_FAST_MATH
+				if(!asin_acos_range(a->v))
+				{
+					CALC_DOMAIN_ERROR(tok_type_i);
+				}
+#endif
+
+				t = a->d / sqrt(1 - a->v * a->v);
+				if(tt == TT_ASIN)
+				{
+					a->d = t;
+					a->v = asin(a->v);
+				}
+				else
+				{
+					a->d = -t;
+					a->v = acos(a->v);
+				}
+				break;
+
+			case TT_ATAN:
+				a->d /= 1 + a->v * a->v;
+				a->v = atan(a->v);
+				break;
+
+			case TT_SQRT:
+#if !CALC_FAST_MATH
+				if(a->v < 0)
+				{
+					CALC_DOMAIN_ERROR(tok_type_i);
+				}
+#endif
+
+				a->v = sqrt(a->v);
+				a->d /= 2 * a->v;
+				break;
+
+			case TT_EXP:
+				a->v = exp(a->v);
+				a->d *= a->v;
+				break;
+
+			case TT_POW:
+				/* A constant exponent also works for a negative
+				base, otherwise d(a^b) = a^b * (b' log(a) + b a'/a) */
+				t = pow(a->v, b->v);
+				if(b->d == 0)
+				{
+					if(a->d != 0)
+					{
+						a->d *= b->v * pow(a->v, b->v - 1);
+					}
+				}
+				else
+				{
+					a->d = t * (b->d * log(a->v) + b->v * a->d / a->v);
+				}
+
+				a->v = t;
+				break;
+			}
+			break;
+		}
+	}
+
+	/* Like in calc_solve, but a function can be
+	finite where its derivative is not, e.g. x^0.5 at 0 */
+#if CALC_Y2
+	y[1] = stack[1].v;
+	dy[1] = fail & 2 || !isfinite(y[1]) ? NAN : stack[1].d;
+	if(fail & 1)
+	{
+		stack[0].v = NAN;
+	}
+#endif
+
+	y[0] = stack[0].v;
+	dy[0] = stack[0].d;
+	if(!isfinite(y[0]) || !isfinite(dy[0]))
+	{
+		return ERROR_MATH;
+	}
+
+	return 0;
+}
@@ -0,0 +1,409 @@
+/* Interval evaluation of the RPN program.
+For an interval of x the result is an interval that contains f(x)
+for every x in it, so a block of table rows whose y interval does not
+contain zero can be skipped without evaluating each row, y[1] is the
+one of Y2 if there is a second function. Every bound is rounded
+outwards by IV_ULP_EXACT units in the last place after + - * /. The
+library functions are assumed to be accurate to IV_ULP_LIBM units of
+the argument and result, which gives an absolute error for sin, cos,
+tan and log and a relative one for pow. The trigonometric functions
+are in radians like in calc_solve. An interval that may contain a
+point where f is undefined, like a pole of tan or log of a negative
+number, is an ERROR_MATH, the caller has to subdivide it. */
+
+#define IV_ULP_EXACT            1
+#define IV_ULP_LIBM             4
+
+/* sin and cos are not subdivided into monotonic segments above
+this, the argument is too coarse for the period there */
+#define IV_TRIG_MAX         20000.0
+
+#if CALC_DOUBLE
+#define IV_TINY               DBL_MIN
+#define IV_EPS                DBL_EPSILON
+#else
+#define IV_TINY               FLT_MIN
+#define IV_EPS                FLT_EPSILON
+#endif
+
+typedef struct INTERVAL
+{
+	num_t lo, hi;
+} Interval;
+
+static num_t iv_next(num_t v, int8_t d);
+static void iv_set(Interval *r, num_t a, num_t b);
+static void iv_widen(Interval *r, uint8_t n);
+static void iv_pad(Interval *r, num_t e);
+static num_t iv_trig_err(num_t x);
+static void iv_mul(Interval *a, const Interval *b);
+static uint8_t iv_hits(const Interval *a, num_t c, num_t period);
+static void iv_trig(Interval *a, uint8_t tt);
+static num_t iv_pow_err(num_t v);
+static uint8_t iv_pow(Interval *a, const Interval *b);
+static uint8_t calc_solve_interval(const Interval *x, Interval *y);
+
+static num_t iv_next(num_t v, int8_t d)
+{
+	/* Neighbour of v in direction d, adjacent floats of the
+	same sign have adjacent bit patterns */
+	union { num_t n; mant_t b; } u;
+	if(v == 0)
+	{
+		return d > 0 ? IV_TINY : -IV_TINY;
+	}
+
+	u.n = v;
+	if((v > 0) == (d > 0))
+	{
+		++u.b;
+	}
+	else
+	{
+		--u.b;
+	}
+
+	return u.n;
+}
+
+static void iv_set(Interval *r, num_t a, num_t b)
+{
+	if(a < b)
+	{
+		r->lo = a;
+		r->hi = b;
+	}
+	else
+	{
+		r->lo = b;
+		r->hi = a;
+	}
+}
+
+static void iv_widen(Interval *r, uint8_t n)
+{
+	for(; n; --n)
+	{
+		r->lo = iv_next(r->lo, -1);
+		r->hi = iv_next(r->hi, 1);
+	}
+}
+
+static void iv_pad(Interval *r, num_t e)
+{
+	r->lo -= e;
+	r->hi += e;
+	iv_widen(r, IV_ULP_EXACT);
+}
+
+static num_t iv_trig_err(num_t x)
+{
+	/* Absolute error of sin and cos at x, the argument
+	reduction loses digits relative to its size */
+	return IV_ULP_LIBM * IV_EPS * (1 + fabs(x));
+}
+
+static void iv_mul(Interval *a, const Interval *b)
+{
+	num_t p[4];
+	uint8_t i;
+	p[0] = a->lo * b->lo;
+	p[1] = a->lo * b->hi;
+	p[2] = a->hi * b->lo;
+	p[3] = a->hi * b->hi;
+	iv_set(a, p[0], p[1]);
+	for(i = 2; i < 4; ++i)
+	{
+		if(p[i] < a->lo)
+		{
+			a->lo = p[i];
+		}
+
+		if(p[i] > a->hi)
+		{
+			a->hi = p[i];
+		}
+	}
+}
+
+static uint8_t iv_hits(const Interval *a, num_t c, num_t period)
+{
+	/* Is there a c + k * period inside a? */
+	return c + period * ceil((a->lo - c) / period) <= a->hi;
+}
+
+static void iv_trig(Interval *a, uint8_t tt)
+{
+	/* sin or cos, the maximum of sin is at pi / 2 and
+	the one of cos at 0, the minimum pi further */
+	Interval r;
+	num_t peak;
+	if(a->hi - a->lo >= 2 * M_PI || a->lo < -IV_TRIG_MAX ||
+		a->hi > IV_TRIG_MAX)
+	{
+		a->lo = -1;
+		a->hi = 1;
+		return;
+	}
+
+	if(tt == TT_SIN)
+	{
+		peak = M_PI / 2;
+		iv_set(&r, sin(a->lo), sin(a->hi));
+	}
+	else
+	{
+		peak = 0;
+		iv_set(&r, cos(a->lo), cos(a->hi));
+	}
+
+	iv_pad(&r, iv_trig_err(fabs(a->lo) > fabs(a->hi) ? a->lo : a->hi));
+	if(iv_hits(a, peak, 2 * M_PI) || r.hi > 1)
+	{
+		r.hi = 1;
+	}
+
+	if(iv_hits(a, peak + M_PI, 2 * M_PI) || r.lo < -1)
+	{
+		r.lo = -1;
+	}
+
+	*a = r;
+}
+
+static num_t iv_pow_err(num_t v)
+{
+	/* pow is exp(b * log(a)), the error of the
+	product is relative to log of the result */
+	if(v == 0)
+	{
+		return 0;
+	}
+
+	v = fabs(v);
+	return IV_ULP_LIBM * IV_EPS * v * (1 + fabs(log(v)));
+}
+
+static uint8_t iv_pow(Interval *a, const Interval *b)
+{
+	/* For a positive base pow is monotonic in both arguments, so the
+	bounds are at the corners. Otherwise only an integer exponent is
+	defined, odd powers are monotonic and even powers have their
+	minimum at zero. */
+	num_t p[4];
+	uint8_t i, n;
+	if(a->lo > 0)
+	{
+		p[0] = pow(a->lo, b->lo);
+		p[1] = pow(a->lo, b->hi);
+		p[2] = pow(a->hi, b->lo);
+		p[3] = pow(a->hi, b->hi);
+		n = 4;
+	}
+	else if(b->lo == b->hi && b->lo == floor(b->lo))
+	{
+		if(a->hi >= 0 && b->lo < 0)
+		{
+			/* pole at zero */
+			return ERROR_MATH;
+		}
+
+		p[0] = pow(a->lo, b->lo);
+		p[1] = pow(a->hi, b->lo);
+		p[2] = a->hi >= 0 && fmod(b->lo, 2) == 0 && b->lo ? 0 : p[0];
+		n = 3;
+	}
+	else
+	{
+		return ERROR_MATH;
+	}
+
+	iv_set(a, p[0], p[1]);
+	for(i = 2; i < n; ++i)
+	{
+		if(p[i] < a->lo)
+		{
+			a->lo = p[i];
+		}
+
+		if(p[i] > a->hi)
+		{
+			a->hi = p[i];
+		}
+	}
+
+	a->lo -= iv_pow_err(a->lo);
+	a->hi += iv_pow_err(a->hi);
+	iv_widen(a, IV_ULP_EXACT);
+	return 0;
+}
+
+static uint8_t calc_solve_interval(const Interval *x, Interval *y)
+{
+	/* Same program as calc_solve. The interval stack shares the
+	memory of the number stack, so it holds half as many entries. */
+	Interval *stack = (Interval *)num_stack, *a, *b;
+	uint8_t tok_type_i, tok_num_i, top_num, tt;
+	if(calc_depth > NUMBER_STACK_SIZE / 2)
+	{
+		return ERROR_NOMEM;
+	}
+
+	tok_type_i = 0;
+	tok_num_i = 0;
+	top_num = 0;
+	for(; tok_type_i < tok_cnt; ++tok_type_i)
+	{
+		switch((tt = tok_type_list[tok_type_i]))
+		{
+		case TT_NUMBER:
+			a = &stack[top_num++];
+			a->lo = a->hi = tok_num_list[tok_num_i++];
+			break;
+
+		case TT_X:
+			stack[top_num++] = *x;
+			break;
+
+		default:
+			if(tt >= TT_ADD)
+			{
+				--top_num;
+			}
+
+			a = &stack[top_num - 1];
+			b = &stack[top_num];
+			switch(tt)
+			{
+			case TT_UNARY_MINUS:
+				iv_set(a, -a->lo, -a->hi);
+				break;
+
+			case TT_ADD:
+				a->lo += b->lo;
+				a->hi += b->hi;
+				iv_widen(a, IV_ULP_EXACT);
+				break;
+
+			case TT_SUB:
+				iv_set(a, a->lo - b->hi, a->hi - b->lo);
+				iv_widen(a, IV_ULP_EXACT);
+				break;
+
+			case TT_MUL:
+				iv_mul(a, b);
+				iv_widen(a, IV_ULP_EXACT);
+				break;
+
+			case TT_DIV:
+				if(b->lo <= 0 && b->hi >= 0)
+				{
+					/* Division by an interval containing zero */
+					return ERROR_MATH;
+				}
+
+				iv_set(b, 1 / b->lo, 1 / b->hi);
+				iv_widen(b, IV_ULP_EXACT);
+				iv_mul(a, b);
+				iv_widen(a, IV_ULP_EXACT);
+				break;
+
+			case TT_LOG:
+				if(a->lo <= 0)
+				{
+					return ERROR_MATH;
+				}
+
+				iv_set(a, log(a->lo), log(a->hi));
+				iv_pad(a, IV_ULP_LIBM * IV_EPS);
+				iv_widen(a, IV_ULP_LIBM);
+				break;
+
+			case TT_SIN:
+			case TT_COS:
+				iv_trig(a, tt);
+				break;
+
+			case TT_TAN:
+				/* Monotonic between the poles at pi / 2 + k * pi */
+				if(a->hi - a->lo >= M_PI || a->lo < -IV_TRIG_MAX ||
+					a->hi > IV_TRIG_MAX || iv_hits(a, M_PI / 2, M_PI))
+				{
+					return ERROR_MATH;
+				}
+
+				/* The argument error is scaled by the
+				derivative 1 + tan^2 */
+				b->lo = tan(a->lo);
+				b->hi = tan(a->hi);
+				a->lo = b->lo - iv_trig_err(a->lo) *
+					(1 + b->lo * b->lo);
+				a->hi = b->hi + iv_trig_err(a->hi) *
+					(1 + b->hi * b->hi);
+				iv_widen(a, IV_ULP_LIBM);
+				break;
+
+			case TT_ASIN:
+			case TT_ACOS:
+				if(a->lo < -1 || a->hi > 1)
+				{
+					return ERROR_MATH;
+				}
+
+				if(tt == TT_ASIN)
+				{
+					iv_set(a, asin(a->lo), asin(a->hi));
+				}
+				else
+				{
+					iv_set(a, acos(a->lo), acos(a->hi));
+				}
+
+				iv_widen(a, IV_ULP_LIBM);
+				break;
+
+			case TT_ATAN:
+				iv_set(a, atan(a->lo), atan(a->hi));
+				iv_widen(a, IV_ULP_LIBM);
+				break;
+
+			case TT_SQRT:
+				if(a->lo < 0)
+				{
+					return ERROR_MATH;
+				}
+
+				iv_set(a, sqrt(a->lo), sqrt(a->hi));
+				iv_widen(a, IV_ULP_LIBM);
+				break;
+
+			case TT_EXP:
+				/* Like pow, the error is relative to the argument */
+				iv_set(a, exp(a->lo), exp(a->hi));
+				a->lo -= iv_pow_err(a->lo);
+				a->hi += iv_pow_err(a->hi);
+				iv_widen(a, IV_ULP_LIBM);
+				break;
+
+			case TT_POW:
+				if(iv_pow(a, b))
+				{
+					return ERROR_MATH;
+				}
+				break;
+			}
+
+			if(!isfinite(a->lo) || !isfinite(a->hi))
+			{
+				return ERROR_MATH;
+			}
+			break;
+		}
+	}
+
+	y[0] = stack[0];
+#if CALC_Y2
+	y[1] = stack[1];
+#endif
+	return 0;
+}
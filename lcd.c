@@ -1,3 +1,4 @@
+/* Delays in us and ms, converted to cycles from F_CPU by util/delay.h */
 #define LCD_DELAY_US_ENABLE    20
 #define LCD_DELAY_US_DATA      46
 #define LCD_DELAY_US_COMMAND   42
@@ -73,6 +74,7 @@
 
 #define LCD_WIDTH              16
 #define LCD_HEIGHT              2
+#define LCD_DDRAM_WIDTH        40
 
 static void lcd_init(void);
 static void lcd_data(uint8_t data);
@@ -5,37 +5,68 @@
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include <math.h>
+#include <float.h>
 #include <ctype.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include "config.h"
 #include "lcd.c"
 
 #define PIN_SHIFT               4
+#define PIN_MODE                5
 
 #define MSG_START_LEN           6
 #define MSG_STEP_LEN            5
+#define MSG_YSTART_LEN          7
+#define MSG_YSTEP_LEN           6
 #define MSG_ERROR_LEN           5
+#define MSG_FIXED_LEN           6
+#define MSG_STAT_X_LEN          2
 #define FIELD_START_WIDTH      16
 #define FIELD_STEP_WIDTH       16
 #define FIELD_NUMBER_WIDTH     16
-#define NUMBER_STACK_SIZE      32
-#define OPERATOR_STACK_SIZE    32
-#define TOKEN_LIST_SIZE        32
+#define FIELD_UNCHANGED    0x7FFF
 #define OUTPUT_PRECISION        4
 #define MODE_TABLE_STEP_BIG    10
-#define TERM_MAX_LEN          256
+#define MODE_TABLE_SEARCH_EVALS 256
+#define MODE_TABLE_SEARCH_BLOCK 4096
+#define NUM_POW10_MAX          10
+#define CALC_CACHE_EMPTY     0xFF
+#define CALC_SEP_NONE        0xFF
+#define KEY_QUEUE_SIZE          4
+#define SUM_TAIL               16
+#define SUM_SHOW_TICKS         25
+#define STAT_SHOW_TICKS        25
+#define ITER_STEPS            100
 
 #define UNSHIFT(key)             (key & ~(1 << 4))
-#define RAD_TO_DEG(rad)          ((rad) * (180.0 / M_PI))
-#define DEG_TO_RAD(deg)          ((deg) * M_PI / 180.0)
-#define SIND(x)                  (sin(DEG_TO_RAD((float)(x))))
-#define COSD(x)                  (cos(DEG_TO_RAD((float)(x))))
-#define TAND(x)                  (tan(DEG_TO_RAD((float)(x))))
-#define ASIND(x)                 (RAD_TO_DEG(asin((float)(x))))
-#define ACOSD(x)                 (RAD_TO_DEG(acos((float)(x))))
-#define ATAND(x)                 (RAD_TO_DEG(atan((float)(x))))
+#define IS_FUNC(c)               ((c) >= TT_LOG && (c) <= TT_EXP)
+#define IS_TRIG(c)               ((c) >= TT_SIN && (c) <= TT_TAN)
+#define IS_ATRIG(c)              ((c) >= TT_ASIN && (c) <= TT_ATAN)
+#if CALC_Y2
+#define CALC_FUNCS               2
+
+/* A domain error only makes the function it occurs in undefined */
+#define CALC_DOMAIN_ERROR(i)     fail |= 1 << ((i) >= calc_sep)
+#else
+#define CALC_FUNCS               1
+#define CALC_DOMAIN_ERROR(i)     return ERROR_MATH
+#endif
+
+#if CALC_DOUBLE
+#define SUM_EPS                  DBL_EPSILON
+#define ITER_EPS                 (4 * DBL_EPSILON)
+#else
+#define SUM_EPS                  FLT_EPSILON
+#define ITER_EPS                 (4 * FLT_EPSILON)
+#endif
+
+#if CALC_DOUBLE
+#define FORMAT_NUMBER(v, s, n)   num_format(v, s, n)
+#else
 #define FORMAT_NUMBER(v, s, n) \
 	(uint8_t *)dtostrf(v, n, OUTPUT_PRECISION, (char *)s)
+#endif
 
 enum KEY
 {
@@ -79,7 +110,14 @@ enum KEY
 	KEY_SHIFT_3_0,
 	KEY_SHIFT_2_0,
 	KEY_SHIFT_1_0,
-	KEY_SHIFT_0_0
+	KEY_SHIFT_0_0,
+
+	/* Mode button, handled by the main loop */
+	KEY_MODE,
+
+	/* Shift pressed and released on its own, handled by the
+	main loop: the next key is one of the second function layer */
+	KEY_ALT
 };
 
 enum PGM_STRING
@@ -101,19 +139,115 @@ enum PGM_STRING
 };
 
 /* Character values for pi and div are taken
-from the Hitachi HD44780 LCD controller datasheet */
+from the Hitachi HD44780 LCD controller datasheet.
+Functions are stored in the term as a single byte, their token
+type TT_LOG to TT_EXP, and shown as their name and '(' */
 enum CHAR
 {
 	CHAR_X = 'x',
+	CHAR_Y = 'y',
 	CHAR_DP = '.',
 	CHAR_LP = '(',
 	CHAR_RP = ')',
 	CHAR_PI = 0xF7, /* 0b11110111 */
+	CHAR_SQRT = 0xE8, /* 0b11101000 */
+	CHAR_SIGMA = 0xF6, /* 0b11110110 */
 	CHAR_ADD = '+',
 	CHAR_SUB = '-',
 	CHAR_MUL = '*',
 	CHAR_DIV = 0xFD, /* 0b11111101 */
 	CHAR_POW = '^',
+	CHAR_SEP = ';',
+};
+
+/* Key actions, the handlers are in _key_actions */
+enum KEY_ACTION
+{
+	KA_NONE,
+	KA_INS,
+	KA_EDIT,
+	KA_X,
+	KA_SOLVE,
+	KA_ENTER,
+	KA_MINUS,
+	KA_FIELD,
+	KA_SETUP,
+	KA_MOVE,
+	KA_RESET,
+	KA_ANGLE,
+#if CALC_DUAL
+	KA_DERIV,
+#endif
+#if CALC_INTERVAL
+	KA_SEARCH,
+#endif
+#if CALC_Y2
+	KA_Y2,
+	KA_VIEW,
+#endif
+#if CALC_XY
+	KA_AXIS,
+#endif
+#if CALC_SUM
+	KA_PAUSE,
+#endif
+#if CALC_ITER
+	KA_STEP,
+#endif
+#if CALC_STAT
+	KA_STAT_ADD,
+	KA_STAT_VIEW,
+	KA_STAT_CLEAR,
+	KA_STAT_TABLE,
+#endif
+};
+
+/* Arguments of KA_EDIT, the editing keys of a field */
+enum KEY_EDIT
+{
+	EDIT_CLEAR,
+	EDIT_DELETE,
+	EDIT_LEFT,
+	EDIT_RIGHT,
+	EDIT_TERM_CLEAR,
+	EDIT_TERM_DELETE,
+};
+
+/* Arguments of KA_ENTER, the mode that is entered */
+enum KEY_ENTER
+{
+	ENTER_INPUT,
+	ENTER_ANGLE,
+	ENTER_TABLE,
+	ENTER_SUM,
+	ENTER_ITER,
+};
+
+enum ANGLE
+{
+	ANGLE_DEG,
+	ANGLE_RAD,
+	ANGLE_GRAD,
+	ANGLE_UNITS
+};
+
+enum STAT_VIEW
+{
+	STAT_N,
+	STAT_MEAN,
+	STAT_VAR,
+	STAT_SD,
+	STAT_MIN,
+	STAT_MAX,
+	STAT_VIEWS
+};
+
+enum ITER_STATE
+{
+	ITER_RUN,
+	ITER_FIXED,
+	ITER_CYCLE,
+	ITER_ERROR
 };
 
 enum TOKEN_TYPE
@@ -122,6 +256,7 @@ enum TOKEN_TYPE
 	TT_NULL,
 	TT_NUMBER,
 	TT_X,
+	TT_Y,
 	TT_LP,
 	TT_RP,
 
@@ -135,6 +270,8 @@ enum TOKEN_TYPE
 	TT_ASIN,
 	TT_ACOS,
 	TT_ATAN,
+	TT_SQRT,
+	TT_EXP,
 
 	/* Binary */
 	TT_ADD,
@@ -144,30 +281,142 @@ enum TOKEN_TYPE
 	TT_POW,
 };
 
+/* Evaluator number type, float and double are
+both 32 bit unless compiled with -mdouble=64 */
+#if CALC_DOUBLE
+typedef double num_t;
+typedef uint64_t mant_t;
+#define NUM_MANTISSA_MAX  1844674407370955160ULL
+#else
+typedef float num_t;
+typedef uint32_t mant_t;
+#define NUM_MANTISSA_MAX  429496729UL
+#endif
+
+/* Literal conversion by num_round: the significand bits, the smallest
+normal exponent, the decimal exponents beyond which every mantissa
+overflows or rounds to 0, and the size of the big integer in bytes */
+#if CALC_DOUBLE
+#define NUM_BITS                53
+#define NUM_EXP_MIN          -1022
+#define NUM_DEC_MAX            308
+#define NUM_DEC_MIN           -343
+#define NUM_BIG_SIZE           160
+#else
+#define NUM_BITS                24
+#define NUM_EXP_MIN           -126
+#define NUM_DEC_MAX             38
+#define NUM_DEC_MIN            -56
+#define NUM_BIG_SIZE            32
+#endif
+
+/* Digits printed by num_fixed, up to 18 for the decimal engine */
+#if CALC_DECIMAL
+typedef uint64_t fixed_t;
+#else
+typedef uint32_t fixed_t;
+#endif
+
+#if CALC_CACHE_SIZE
+typedef struct CACHE_ENTRY
+{
+	num_t x, y[CALC_FUNCS];
+	uint8_t err;
+} CacheEntry;
+#endif
+
+#if CALC_IR
+/* Instruction of the register program, *d = *a op *b */
+typedef struct IR_INS
+{
+	uint8_t op;
+	num_t *d;
+	const num_t *a, *b;
+} IrIns;
+#endif
+
+/* Row value = (x0 + pos * dx) * 10^exp when exact,
+start + pos * step otherwise */
+typedef struct AXIS
+{
+	num_t start, step;
+	int32_t pos, pos_max, x0, dx;
+	int16_t exp;
+	uint8_t exact;
+} Axis;
+
+typedef struct KEY_MAP
+{
+	uint8_t action, arg;
+} KeyMap;
+
 typedef struct FIELD
 {
-	uint8_t row, col, width;
+	uint8_t row, col, width, cap;
 	uint8_t *buf;
 	int16_t pos, len, max;
+	int16_t cpos, clen, off, drawn;
+	int16_t base, res, res_end;
 } Field;
 
 /* Constants in Flash Memory */
-static const uint8_t _str_sin[] PROGMEM = "sin";
-static const uint8_t _str_cos[] PROGMEM = "cos";
-static const uint8_t _str_tan[] PROGMEM = "tan";
-static const uint8_t _str_asin[] PROGMEM = "asin";
-static const uint8_t _str_acos[] PROGMEM = "acos";
-static const uint8_t _str_atan[] PROGMEM = "atan";
-static const uint8_t _str_log[] PROGMEM = "log";
+static const uint8_t _str_log[] PROGMEM = "log(";
+static const uint8_t _str_sin[] PROGMEM = "sin(";
+static const uint8_t _str_cos[] PROGMEM = "cos(";
+static const uint8_t _str_tan[] PROGMEM = "tan(";
+static const uint8_t _str_asin[] PROGMEM = "asin(";
+static const uint8_t _str_acos[] PROGMEM = "acos(";
+static const uint8_t _str_atan[] PROGMEM = "atan(";
+static const uint8_t _str_sqrt[] PROGMEM = { CHAR_SQRT, '(', '\0' };
+static const uint8_t _str_exp[] PROGMEM = "exp(";
 static const uint8_t _str_start[] PROGMEM = "START=";
 static const uint8_t _str_step[] PROGMEM = "STEP=";
+#if CALC_XY
+static const uint8_t _str_ystart[] PROGMEM = "YSTART=";
+static const uint8_t _str_ystep[] PROGMEM = "YSTEP=";
+#endif
 static const uint8_t _str_error[] PROGMEM = "ERROR";
+static const uint8_t _str_angle[] PROGMEM = "ANGLE=";
+static const uint8_t _str_deg[] PROGMEM = "DEG";
+static const uint8_t _str_rad[] PROGMEM = "RAD";
+static const uint8_t _str_grad[] PROGMEM = "GRAD";
+#if CALC_ITER
+static const uint8_t _str_fixed[] PROGMEM = " FIXED";
+#endif
+#if CALC_STAT
+static const uint8_t _str_n[] PROGMEM = "N=";
+static const uint8_t _str_mean[] PROGMEM = "MEAN=";
+static const uint8_t _str_var[] PROGMEM = "VAR=";
+static const uint8_t _str_sd[] PROGMEM = "SD=";
+static const uint8_t _str_min[] PROGMEM = "MIN=";
+static const uint8_t _str_max[] PROGMEM = "MAX=";
+#endif
 static const uint8_t _str_press_any_key[] PROGMEM = "Press any key";
 static const uint8_t _str_syntax_error[] PROGMEM = "Syntax Error";
 static const uint8_t _str_math_error[] PROGMEM = "Math. Error";
 static const uint8_t _str_not_enough_mem[] PROGMEM = "Not enough mem.";
 static const uint8_t _str_range_error[] PROGMEM = "Range Error";
 
+/* Powers of ten that are exactly representable as float */
+static const float _pow10_P[NUM_POW10_MAX + 1] PROGMEM =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10
+};
+
+/* Function names in the order of their token types */
+static const uint8_t *const _func_names[] PROGMEM =
+{
+	_str_log,
+	_str_sin,
+	_str_cos,
+	_str_tan,
+	_str_asin,
+	_str_acos,
+	_str_atan,
+	_str_sqrt,
+	_str_exp
+};
+
 static const uint8_t *const _err_msg[] PROGMEM =
 {
 	_str_syntax_error,
@@ -176,6 +425,33 @@ static const uint8_t *const _err_msg[] PROGMEM =
 	_str_range_error
 };
 
+static const uint8_t *const _angle_name[] PROGMEM =
+{
+	_str_deg,
+	_str_rad,
+	_str_grad
+};
+
+/* Radians per unit and back, nothing for radians */
+static const num_t _angle_k_P[ANGLE_UNITS][2] PROGMEM =
+{
+	{ M_PI / 180.0, 180.0 / M_PI },
+	{ 1, 1 },
+	{ M_PI / 200.0, 200.0 / M_PI }
+};
+
+#if CALC_STAT
+static const uint8_t *const _stat_label[] PROGMEM =
+{
+	_str_n,
+	_str_mean,
+	_str_var,
+	_str_sd,
+	_str_min,
+	_str_max
+};
+#endif
+
 static Field fld_term;
 static uint8_t buf_term[TERM_MAX_LEN];
 static uint8_t x_cnt;
@@ -186,87 +462,577 @@ static uint8_t buf_start[FIELD_START_WIDTH];
 static Field fld_step;
 static uint8_t buf_step[FIELD_STEP_WIDTH];
 
+#if CALC_XY
+static Field fld_ystart;
+static uint8_t buf_ystart[FIELD_START_WIDTH];
+
+static Field fld_ystep;
+static uint8_t buf_ystep[FIELD_STEP_WIDTH];
+#endif
+
 static Field *tbl_cur_fld;
-static float tbl_pos, tbl_start, tbl_step;
+
+#if CALC_STAT
+static Field fld_stat;
+static uint8_t buf_stat[FIELD_NUMBER_WIDTH];
+
+/* Welford's accumulators: mean and the sum of squared differences
+from it of stat_n samples, updated per sample without storing it */
+static num_t stat_mean, stat_m2, stat_min, stat_max;
+static uint32_t stat_n;
+static uint8_t stat_view;
+
+/* Table rows added in the background, stat_pos is the next one */
+static int32_t stat_pos, stat_end;
+static uint8_t stat_shown;
+#endif
+
+/* The axis moved in table mode */
+static Axis tbl;
+#if CALC_XY
+/* The other one and the variable of tbl, CHAR_X or CHAR_Y */
+static Axis tbl_fixed;
+static uint8_t tbl_var;
+/* The first row shows the fixed variable instead */
+static uint8_t tbl_fix;
+#endif
+#if CALC_DUAL
+static uint8_t tbl_deriv;
+#endif
+#if CALC_Y2
+/* Second row: 0 Y1, 1 Y2, 2 Y1 - Y2 */
+static uint8_t tbl_view;
+#endif
+
+#if CALC_SUM
+/* Neumaier sum s + c of the rows pos to end, n of them so far.
+With open the sum stops once the terms do not change it anymore. */
+static num_t sum_s, sum_c;
+static int32_t sum_pos, sum_end;
+static uint32_t sum_n, sum_total, sum_ticks;
+static uint8_t sum_open, sum_small, sum_done, sum_err;
+static uint8_t sum_last, sum_shown;
+#endif
+
+#if CALC_ITER
+/* u(n) after iter_n steps, the value saved by the cycle detection
+and the steps since then, which is the period once it comes again */
+static num_t iter_u, iter_save;
+static uint32_t iter_n, iter_lam, iter_pow;
+static uint8_t iter_state;
+#endif
 
 static uint8_t tok_cnt;
+static uint8_t calc_depth;
+
+/* Angle unit of the trigonometric functions, an ANGLE */
+static uint8_t calc_angle;
+#if CALC_XY
+/* The term has y */
+static uint8_t calc_y;
+#endif
+#if CALC_Y2
+/* First token of Y2 in the program, or CALC_SEP_NONE */
+static uint8_t calc_sep;
+#endif
+#if CALC_DECIMAL
+static uint8_t calc_exact;
+#endif
 static uint8_t op_stack[OPERATOR_STACK_SIZE];
-static float num_stack[NUMBER_STACK_SIZE];
+static num_t num_stack[NUMBER_STACK_SIZE];
 static uint8_t tok_type_list[TOKEN_LIST_SIZE];
-static float tok_num_list[TOKEN_LIST_SIZE];
+static num_t tok_num_list[TOKEN_LIST_SIZE];
+
+#if CALC_CACHE_SIZE
+static CacheEntry calc_cache[CALC_CACHE_SIZE];
+#endif
+
+#if CALC_IR
+/* The register program of calc_solve, function f ends before
+calc_ir[calc_ir_end[f]] with its result in *calc_ir_res[f] */
+static IrIns calc_ir[TOKEN_LIST_SIZE];
+static uint8_t calc_ir_end[CALC_FUNCS];
+static const num_t *calc_ir_res[CALC_FUNCS];
+static num_t calc_ir_x;
+#endif
 
 static uint8_t _buf_conv[LCD_WIDTH + 1];
 
 static const Field _fld_term_P PROGMEM =
 {
-	0, 0, LCD_WIDTH,
+	0, 0, LCD_WIDTH, LCD_DDRAM_WIDTH,
 	buf_term,
-	0, 0, TERM_MAX_LEN
+	0, 0, TERM_MAX_LEN,
+	0, 0, 0, 0,
+	0, 0, 0
 };
 
 static const Field _fld_start_P PROGMEM =
 {
 	0, MSG_START_LEN, LCD_WIDTH - MSG_START_LEN,
+	LCD_WIDTH - MSG_START_LEN,
 	buf_start,
-	0, 0, FIELD_START_WIDTH
+	0, 0, FIELD_START_WIDTH,
+	0, 0, 0, 0,
+	0, 0, 0
 };
 
 static const Field _fld_step_P PROGMEM =
 {
 	1, MSG_STEP_LEN, LCD_WIDTH - MSG_STEP_LEN,
+	LCD_WIDTH - MSG_STEP_LEN,
 	buf_step,
-	0, 0, FIELD_STEP_WIDTH
+	0, 0, FIELD_STEP_WIDTH,
+	0, 0, 0, 0,
+	0, 0, 0
+};
+
+#if CALC_XY
+static const Field _fld_ystart_P PROGMEM =
+{
+	0, MSG_YSTART_LEN, LCD_WIDTH - MSG_YSTART_LEN,
+	LCD_WIDTH - MSG_YSTART_LEN,
+	buf_ystart,
+	0, 0, FIELD_START_WIDTH,
+	0, 0, 0, 0,
+	0, 0, 0
+};
+
+static const Field _fld_ystep_P PROGMEM =
+{
+	1, MSG_YSTEP_LEN, LCD_WIDTH - MSG_YSTEP_LEN,
+	LCD_WIDTH - MSG_YSTEP_LEN,
+	buf_ystep,
+	0, 0, FIELD_STEP_WIDTH,
+	0, 0, 0, 0,
+	0, 0, 0
 };
+#endif
+
+#if CALC_STAT
+static const Field _fld_stat_P PROGMEM =
+{
+	1, MSG_STAT_X_LEN, LCD_WIDTH - MSG_STAT_X_LEN,
+	LCD_WIDTH - MSG_STAT_X_LEN,
+	buf_stat,
+	0, 0, FIELD_NUMBER_WIDTH,
+	0, 0, 0, 0,
+	0, 0, 0
+};
+#endif
 
 static void (*_event)(uint8_t);
 static void (*_mode)(void);
 
+/* Background job of a mode, run by the main loop between keys */
+static void (*_job)(void);
+
+/* Keys from the scanning interrupt and its 100 Hz tick */
+static volatile uint8_t key_queue[KEY_QUEUE_SIZE];
+static volatile uint8_t key_head, key_tail;
+static volatile uint8_t ticks;
+static uint8_t key_alt;
+
 /* Field */
 static void field_grow(Field *f, uint8_t n);
 static void field_shrink(Field *f, uint8_t n);
 static void field_ins_chr(Field *f, uint8_t c);
-static void field_ins_str_P(Field *f, const uint8_t *s, uint8_t n);
 static void field_clear(Field *f);
 static void field_delete(Field *f);
 static void field_mv_left(Field *f);
 static void field_mv_right(Field *f);
-static void field_update(Field *f);
+static void field_update(Field *f, int16_t from);
+static void field_redraw(Field *f);
+static void field_put(Field *f, int16_t i, int16_t end);
+static uint8_t field_col(Field *f, int16_t i);
+static uint8_t field_chr_width(uint8_t c);
+static uint8_t field_chr(uint8_t c, uint8_t k);
 
 /* Term Field */
 static void field_term_delete(Field *f);
-static void field_term_mv_left(Field *f);
-static void field_term_mv_right(Field *f);
-
-/* Number Field */
-static void field_number_event(Field *f, uint8_t key);
 
 /* Input Mode */
 static void mode_input(void);
 static void mode_input_event(uint8_t key);
 
 /* Result Mode */
-static void mode_result(float y);
+static void mode_result(const uint8_t *s);
 static void mode_result_event(uint8_t key);
 
 /* Table Mode */
 static void mode_table(void);
 static void mode_table_event(uint8_t key);
 static void mode_table_update(void);
+static uint8_t tbl_label(uint8_t *s);
+static num_t tbl_x(const Axis *a, int32_t pos);
+static uint8_t tbl_solve(num_t x, num_t *y);
+static uint8_t tbl_pick(const num_t *v, uint8_t err, num_t *y);
+#if CALC_SUM || CALC_ITER || CALC_STAT
+static void lcd_uint(uint32_t n, uint8_t width);
+#endif
+
+/* Sum Mode */
+#if CALC_SUM
+static void mode_sum(void);
+static void mode_sum_event(uint8_t key);
+static void sum_run(uint8_t on);
+static void sum_job(void);
+static void sum_show(void);
+#endif
+
+/* Iteration Mode */
+#if CALC_ITER
+static void mode_iter(void);
+static void mode_iter_event(uint8_t key);
+static void mode_iter_update(void);
+#endif
+
+/* Statistics Mode */
+#if CALC_STAT
+static void mode_stat(void);
+static void mode_stat_event(uint8_t key);
+static void mode_stat_update(void);
+static void stat_add(num_t x);
+static uint8_t stat_value(num_t *v);
+static void stat_table_job(void);
+static void stat_table_show(void);
+#endif
 
 /* Settings Mode */
 static void mode_settings(void);
 static void mode_settings_event(uint8_t key);
+static void mode_settings_page(uint8_t p);
+static uint8_t tbl_setup(void);
+static uint8_t tbl_axis(Axis *a, uint8_t *start, uint8_t *step);
+static uint8_t tbl_align(mant_t *m, int16_t n);
+#if CALC_XY
+static uint8_t tbl_fold(void);
+#endif
+
+/* Angle Mode */
+static void mode_angle(void);
+static void mode_angle_event(uint8_t key);
 
 /* Error Mode */
 static void mode_error(uint8_t err);
 static void mode_error_event(uint8_t key);
 
+/* Key Actions */
+static void key_dispatch(const KeyMap *map, Field *f, uint8_t key);
+static void key_edit(Field *f, uint8_t op);
+static void key_x(Field *f, uint8_t arg);
+static void key_solve(Field *f, uint8_t arg);
+static void key_enter(Field *f, uint8_t mode);
+static void key_minus(Field *f, uint8_t arg);
+static void key_field(Field *f, uint8_t arg);
+static void key_setup(Field *f, uint8_t arg);
+static void key_move(Field *f, uint8_t d);
+static void key_reset(Field *f, uint8_t arg);
+static void key_angle(Field *f, uint8_t arg);
+#if CALC_DUAL
+static void key_deriv(Field *f, uint8_t arg);
+#endif
+#if CALC_INTERVAL
+static void key_search(Field *f, uint8_t arg);
+#endif
+#if CALC_Y2
+static void key_y2(Field *f, uint8_t arg);
+static void key_view(Field *f, uint8_t arg);
+#endif
+#if CALC_XY
+static void key_axis(Field *f, uint8_t fix);
+#endif
+#if CALC_SUM
+static void key_pause(Field *f, uint8_t arg);
+#endif
+#if CALC_ITER
+static void key_step(Field *f, uint8_t n);
+#endif
+#if CALC_STAT
+static void key_mode(void);
+static void key_stat_add(Field *f, uint8_t arg);
+static void key_stat_view(Field *f, uint8_t d);
+static void key_stat_clear(Field *f, uint8_t arg);
+static void key_stat_table(Field *f, uint8_t arg);
+#endif
+
+/* Number Parsing */
+static uint8_t num_scan(uint8_t **s, mant_t *m, int16_t *e, uint8_t **rest);
+static num_t num_scale(mant_t m, int16_t e, const uint8_t *rest);
+static num_t num_round(mant_t m, int16_t e, uint8_t sticky);
+static uint8_t num_tie(const uint8_t *rest, mant_t m, int16_t e, num_t r);
+static uint8_t num_big_bit(const uint8_t *big, uint16_t n);
+static void num_big_mul(uint8_t *big, uint8_t f);
+static void num_big_pow(uint8_t *big, uint8_t f, uint16_t n);
+static uint8_t num_parse(uint8_t *s, mant_t *m, int16_t *e, uint8_t *neg,
+	uint8_t **rest);
+static uint8_t *num_fixed(fixed_t m, uint8_t neg, int16_t e, uint8_t *s,
+	uint8_t width);
+#if CALC_DOUBLE
+static uint8_t *num_format(num_t v, uint8_t *s, uint8_t width);
+#endif
+
 /* Calculation */
 static uint8_t calc_prepare(uint8_t *term);
-static uint8_t calc_solve(float x, float *y);
-static uint8_t asin_acos_range(float n);
+static uint8_t calc_pop(uint8_t n);
+static void calc_simplify(void);
+static uint8_t calc_convert(void);
+static uint8_t calc_check(void);
+#if CALC_IR
+static void calc_lower(void);
+#endif
+static uint8_t calc_solve(num_t x, num_t *y);
+static uint8_t calc_op(uint8_t tt, num_t *r, num_t a, num_t b);
+#if CALC_DECIMAL
+static uint8_t dec_solve(uint8_t *term, uint8_t *s, uint8_t width);
+#endif
+#if !CALC_FAST_MATH
+static uint8_t asin_acos_range(num_t n);
+#endif
 static uint8_t get_precedence(uint8_t tt);
 
+/* Key Scanning Interrupt */
+static void key_put(uint8_t key);
+
+/* Key Maps: action and argument for every key code of a mode */
+static void (*const _key_actions[])(Field *, uint8_t) PROGMEM =
+{
+	field_ins_chr,
+	key_edit,
+	key_x,
+	key_solve,
+	key_enter,
+	key_minus,
+	key_field,
+	key_setup,
+	key_move,
+	key_reset,
+	key_angle,
+#if CALC_DUAL
+	key_deriv,
+#endif
+#if CALC_INTERVAL
+	key_search,
+#endif
+#if CALC_Y2
+	key_y2,
+	key_view,
+#endif
+#if CALC_XY
+	key_axis,
+#endif
+#if CALC_SUM
+	key_pause,
+#endif
+#if CALC_ITER
+	key_step,
+#endif
+#if CALC_STAT
+	key_stat_add,
+	key_stat_view,
+	key_stat_clear,
+	key_stat_table,
+#endif
+};
+
+static const KeyMap _keys_input_P[32] PROGMEM =
+{
+	[KEY_0_0] = { KA_INS, '1' },
+	[KEY_1_0] = { KA_INS, '2' },
+	[KEY_2_0] = { KA_INS, '3' },
+	[KEY_3_0] = { KA_EDIT, EDIT_TERM_CLEAR },
+	[KEY_0_1] = { KA_INS, '4' },
+	[KEY_1_1] = { KA_INS, '5' },
+	[KEY_2_1] = { KA_INS, '6' },
+	[KEY_3_1] = { KA_EDIT, EDIT_TERM_DELETE },
+	[KEY_0_2] = { KA_INS, '7' },
+	[KEY_1_2] = { KA_INS, '8' },
+	[KEY_2_2] = { KA_INS, '9' },
+	[KEY_3_2] = { KA_INS, CHAR_DP },
+	[KEY_0_3] = { KA_INS, CHAR_LP },
+	[KEY_1_3] = { KA_INS, '0' },
+	[KEY_2_3] = { KA_INS, CHAR_RP },
+	[KEY_3_3] = { KA_SOLVE, 0 },
+
+	[KEY_SHIFT_0_0] = { KA_INS, TT_SIN },
+	[KEY_SHIFT_1_0] = { KA_INS, TT_COS },
+	[KEY_SHIFT_2_0] = { KA_INS, TT_TAN },
+	[KEY_SHIFT_3_0] = { KA_INS, CHAR_ADD },
+	[KEY_SHIFT_0_1] = { KA_EDIT, EDIT_LEFT },
+	[KEY_SHIFT_1_1] = { KA_INS, CHAR_PI },
+	[KEY_SHIFT_2_1] = { KA_EDIT, EDIT_RIGHT },
+	[KEY_SHIFT_3_1] = { KA_INS, CHAR_SUB },
+	[KEY_SHIFT_0_2] = { KA_X, 0 },
+	[KEY_SHIFT_1_2] = { KA_INS, CHAR_POW },
+	[KEY_SHIFT_2_2] = { KA_INS, TT_LOG },
+	[KEY_SHIFT_3_2] = { KA_INS, CHAR_MUL },
+	[KEY_SHIFT_0_3] = { KA_INS, TT_ASIN },
+	[KEY_SHIFT_1_3] = { KA_INS, TT_ACOS },
+	[KEY_SHIFT_2_3] = { KA_INS, TT_ATAN },
+	[KEY_SHIFT_3_3] = { KA_INS, CHAR_DIV }
+};
+
+/* Second function layer of input mode, after shift on its own */
+static const KeyMap _keys_alt_P[16] PROGMEM =
+{
+	[KEY_1_2] = { KA_INS, TT_SQRT },
+	[KEY_2_2] = { KA_INS, TT_EXP },
+	[KEY_2_3] = { KA_ENTER, ENTER_ANGLE }
+};
+
+static const KeyMap _keys_settings_P[32] PROGMEM =
+{
+	[KEY_0_0] = { KA_INS, '1' },
+	[KEY_1_0] = { KA_INS, '2' },
+	[KEY_2_0] = { KA_INS, '3' },
+	[KEY_3_0] = { KA_EDIT, EDIT_CLEAR },
+	[KEY_0_1] = { KA_INS, '4' },
+	[KEY_1_1] = { KA_INS, '5' },
+	[KEY_2_1] = { KA_INS, '6' },
+	[KEY_3_1] = { KA_EDIT, EDIT_DELETE },
+	[KEY_0_2] = { KA_INS, '7' },
+	[KEY_1_2] = { KA_INS, '8' },
+	[KEY_2_2] = { KA_INS, '9' },
+	[KEY_3_2] = { KA_INS, CHAR_DP },
+#if CALC_Y2
+	[KEY_0_3] = { KA_Y2, 0 },
+#endif
+	[KEY_1_3] = { KA_INS, '0' },
+	[KEY_2_3] = { KA_ENTER, ENTER_ANGLE },
+	[KEY_3_3] = { KA_SETUP, 0 },
+
+	[KEY_SHIFT_0_0] = { KA_ENTER, ENTER_INPUT },
+	[KEY_SHIFT_1_0] = { KA_FIELD, 0 },
+	[KEY_SHIFT_0_1] = { KA_EDIT, EDIT_LEFT },
+	[KEY_SHIFT_2_1] = { KA_EDIT, EDIT_RIGHT },
+	[KEY_SHIFT_3_1] = { KA_MINUS, 0 },
+	[KEY_SHIFT_1_2] = { KA_FIELD, 1 }
+};
+
+/* Shift is ignored in angle mode, any key but DRG continues */
+static const KeyMap _keys_angle_P[16] PROGMEM =
+{
+	[KEY_0_0] = { KA_SOLVE, 0 },
+	[KEY_1_0] = { KA_SOLVE, 0 },
+	[KEY_2_0] = { KA_SOLVE, 0 },
+	[KEY_3_0] = { KA_SOLVE, 0 },
+	[KEY_0_1] = { KA_SOLVE, 0 },
+	[KEY_1_1] = { KA_SOLVE, 0 },
+	[KEY_2_1] = { KA_SOLVE, 0 },
+	[KEY_3_1] = { KA_SOLVE, 0 },
+	[KEY_0_2] = { KA_SOLVE, 0 },
+	[KEY_1_2] = { KA_SOLVE, 0 },
+	[KEY_2_2] = { KA_SOLVE, 0 },
+	[KEY_3_2] = { KA_SOLVE, 0 },
+	[KEY_0_3] = { KA_SOLVE, 0 },
+	[KEY_1_3] = { KA_SOLVE, 0 },
+	[KEY_2_3] = { KA_ANGLE, 0 },
+	[KEY_3_3] = { KA_SOLVE, 0 }
+};
+
+/* Shift is ignored in table mode */
+static const KeyMap _keys_table_P[16] PROGMEM =
+{
+	[KEY_0_0] = { KA_ENTER, ENTER_INPUT },
+	[KEY_1_0] = { KA_MOVE, (uint8_t)-1 },
+#if CALC_Y2
+	[KEY_2_0] = { KA_VIEW, 0 },
+#endif
+#if CALC_DUAL
+	[KEY_3_0] = { KA_DERIV, 0 },
+#endif
+	[KEY_0_1] = { KA_MOVE, (uint8_t)-MODE_TABLE_STEP_BIG },
+	[KEY_1_1] = { KA_RESET, 0 },
+	[KEY_2_1] = { KA_MOVE, MODE_TABLE_STEP_BIG },
+#if CALC_SUM
+	[KEY_3_1] = { KA_ENTER, ENTER_SUM },
+#endif
+#if CALC_ITER
+	[KEY_2_2] = { KA_ENTER, ENTER_ITER },
+#endif
+#if CALC_STAT
+	[KEY_1_3] = { KA_STAT_TABLE, 0 },
+#endif
+#if CALC_XY
+	[KEY_0_2] = { KA_AXIS, 0 },
+	[KEY_0_3] = { KA_AXIS, 1 },
+#endif
+	[KEY_1_2] = { KA_MOVE, 1 },
+#if CALC_INTERVAL
+	[KEY_3_2] = { KA_SEARCH, (uint8_t)-1 },
+	[KEY_3_3] = { KA_SEARCH, 1 },
+#endif
+};
+
+#if CALC_SUM
+/* Shift is ignored in sum mode */
+static const KeyMap _keys_sum_P[16] PROGMEM =
+{
+	[KEY_0_0] = { KA_ENTER, ENTER_TABLE },
+	[KEY_3_3] = { KA_PAUSE, 0 }
+};
+#endif
+
+#if CALC_ITER
+/* Shift is ignored in iteration mode, the steps are
+on the keys of the rows in table mode */
+static const KeyMap _keys_iter_P[16] PROGMEM =
+{
+	[KEY_0_0] = { KA_ENTER, ENTER_TABLE },
+	[KEY_2_1] = { KA_STEP, MODE_TABLE_STEP_BIG },
+	[KEY_1_2] = { KA_STEP, 1 },
+	[KEY_3_3] = { KA_STEP, ITER_STEPS }
+};
+#endif
+
+#if CALC_STAT
+static const KeyMap _keys_stat_P[32] PROGMEM =
+{
+	[KEY_0_0] = { KA_INS, '1' },
+	[KEY_1_0] = { KA_INS, '2' },
+	[KEY_2_0] = { KA_INS, '3' },
+	[KEY_3_0] = { KA_EDIT, EDIT_CLEAR },
+	[KEY_0_1] = { KA_INS, '4' },
+	[KEY_1_1] = { KA_INS, '5' },
+	[KEY_2_1] = { KA_INS, '6' },
+	[KEY_3_1] = { KA_EDIT, EDIT_DELETE },
+	[KEY_0_2] = { KA_INS, '7' },
+	[KEY_1_2] = { KA_INS, '8' },
+	[KEY_2_2] = { KA_INS, '9' },
+	[KEY_3_2] = { KA_INS, CHAR_DP },
+	[KEY_0_3] = { KA_STAT_VIEW, (uint8_t)-1 },
+	[KEY_1_3] = { KA_INS, '0' },
+	[KEY_2_3] = { KA_STAT_VIEW, 1 },
+	[KEY_3_3] = { KA_STAT_ADD, 0 },
+
+	[KEY_SHIFT_0_0] = { KA_ENTER, ENTER_INPUT },
+	[KEY_SHIFT_3_0] = { KA_STAT_CLEAR, 0 },
+	[KEY_SHIFT_0_1] = { KA_EDIT, EDIT_LEFT },
+	[KEY_SHIFT_2_1] = { KA_EDIT, EDIT_RIGHT },
+	[KEY_SHIFT_3_1] = { KA_MINUS, 0 }
+};
+#endif
+
+#if CALC_DECIMAL
+#include "decimal.c"
+#endif
+
+#if CALC_INTERVAL
+#include "interval.c"
+#endif
+
+#if CALC_DUAL
+#include "dual.c"
+#endif
+
+#if CALC_XY
+#include "partial.c"
+#endif
+
+#ifdef BENCH
+#include "bench.c"
+#endif
+
 int main(void)
 {
 	lcd_init();
@@ -280,8 +1046,8 @@ int main(void)
 	/* Enable compare match interrupt */
 	TIMSK2 = (1 << OCIE2A);
 
-	/* 100 Hz / 10 ms at F_OSC = 8 MHz */
-	OCR2A = 78;
+	/* 100 Hz / 10 ms at any F_CPU */
+	OCR2A = KEY_SCAN_OCR;
 
 	/* Internal pullups on shift and mode button
 	pins and on all other unused pins */
@@ -292,6 +1058,17 @@ int main(void)
 	memcpy_P(&fld_term, &_fld_term_P, sizeof(Field));
 	memcpy_P(&fld_start, &_fld_start_P, sizeof(Field));
 	memcpy_P(&fld_step, &_fld_step_P, sizeof(Field));
+#if CALC_XY
+	memcpy_P(&fld_ystart, &_fld_ystart_P, sizeof(Field));
+	memcpy_P(&fld_ystep, &_fld_ystep_P, sizeof(Field));
+#endif
+#if CALC_STAT
+	memcpy_P(&fld_stat, &_fld_stat_P, sizeof(Field));
+#endif
+#ifdef BENCH
+	bench();
+#endif
+
 	mode_input();
 
 	sei();
@@ -304,9 +1081,55 @@ int main(void)
 	power_timer0_disable();
 	power_timer1_disable();
 	power_usart0_disable();
+#ifdef power_usart1_disable
+	power_usart1_disable();
+#endif
+#ifdef power_timer3_disable
+	power_timer3_disable();
+#endif
 	sleep_enable();
 	set_sleep_mode(SLEEP_MODE_PWR_SAVE);
-	for(;;) { sleep_cpu(); }
+	for(;;)
+	{
+		/* Keys first, then the background job, otherwise sleep
+		until the next interrupt. The instruction after sei runs
+		before a pending interrupt, so a key that arrives after
+		the check still wakes sleep_cpu up. */
+		uint8_t key;
+		cli();
+		if(key_tail != key_head)
+		{
+			key = key_queue[key_tail];
+			key_tail = (key_tail + 1) & (KEY_QUEUE_SIZE - 1);
+			sei();
+#if CALC_STAT
+			if(key == KEY_MODE)
+			{
+				key_mode();
+				continue;
+			}
+#endif
+			if(key == KEY_ALT)
+			{
+				key_alt = 1;
+				continue;
+			}
+
+			_event(key);
+			key_alt = 0;
+		}
+		else if(_job)
+		{
+			sei();
+			_job();
+		}
+		else
+		{
+			sei();
+			sleep_cpu();
+		}
+	}
+
 	return 0;
 }
 
@@ -342,24 +1165,12 @@ static void field_ins_chr(Field *f, uint8_t c)
 {
 	if(f->len + 1 < f->max)
 	{
+		uint8_t w = field_chr_width(c);
 		field_grow(f, 1);
-		f->buf [f->pos++] = c;
-		field_update(f);
-	}
-}
-
-static void field_ins_str_P(Field *f, const uint8_t *s, uint8_t n)
-{
-	if(f->len + n + 1 < f->max)
-	{
-		field_grow(f, n + 1);
-		while(n--)
-		{
-			f->buf[f->pos++] = pgm_read_byte(s++);
-		}
-
-		f->buf[f->pos++] = '(';
-		field_update(f);
+		f->buf[f->pos++] = c;
+		f->cpos += w;
+		f->clen += w;
+		field_update(f, f->cpos - w);
 	}
 }
 
@@ -367,19 +1178,24 @@ static void field_clear(Field *f)
 {
 	f->len = 0;
 	f->pos = 0;
+	f->clen = 0;
+	f->cpos = 0;
 	f->buf[0] = '\0';
-	field_update(f);
+	field_update(f, 0);
 }
 
 static void field_delete(Field *f)
 {
 	if(f->pos > 0)
 	{
+		uint8_t w = field_chr_width(f->buf[f->pos - 1]);
 		field_shrink(f, 1);
 		--(f->pos);
 		--(f->len);
 		f->buf[f->len] = '\0';
-		field_update(f);
+		f->cpos -= w;
+		f->clen -= w;
+		field_update(f, f->cpos);
 	}
 }
 
@@ -387,198 +1203,234 @@ static void field_mv_left(Field *f)
 {
 	if(f->pos > 0)
 	{
-		--(f->pos);
+		f->cpos -= field_chr_width(f->buf[--(f->pos)]);
 	}
 	else
 	{
 		f->pos = f->len;
+		f->cpos = f->clen;
 	}
 
-	field_update(f);
+	field_update(f, FIELD_UNCHANGED);
 }
 
 static void field_mv_right(Field *f)
 {
 	if(f->pos < f->len)
 	{
-		++(f->pos);
+		f->cpos += field_chr_width(f->buf[(f->pos)++]);
 	}
 	else
 	{
 		f->pos = 0;
+		f->cpos = 0;
 	}
 
-	field_update(f);
+	field_update(f, FIELD_UNCHANGED);
 }
 
-static void field_update(Field *f)
+static void field_update(Field *f, int16_t from)
 {
-	int8_t i;
-	if(f->pos < f->width - 1)
+	/* The characters buf[res, res_end) are kept in DDRAM, at column
+	(i - base) mod cap of the field, and buf[off, off + width) is the
+	visible part of them. The term field uses all 40 columns of a DDRAM
+	row, so moving its window by a column is a single display shift
+	command and at most one character written. The other fields share
+	their rows with labels and cannot be shifted, their window is
+	recentred on the cursor and rewritten instead. Only characters
+	from the first changed one on, up to the last one that was on
+	the display before (drawn), are rewritten. All of these are
+	display columns, a function takes several of them. */
+	int16_t off, end, hi, d, a, b;
+	hi = f->clen > f->drawn ? f->clen : f->drawn;
+	f->drawn = f->clen;
+	off = f->off;
+	if(f->cpos < off || f->cpos >= off + f->width)
 	{
-		lcd_cursor(f->col, f->row);
-		for(i = 0; f->buf[i]; ++i)
+		if(f->cap > f->width)
 		{
-			lcd_data(f->buf[i]);
+			off = f->cpos < off ? f->cpos : f->cpos - f->width + 1;
 		}
-
-		for(; i < f->width; ++i)
+		else if((off = f->cpos - f->width / 2) < 0)
 		{
-			lcd_data(' ');
+			off = 0;
 		}
+	}
 
-		lcd_cursor(f->col + f->pos, f->row);
+	/* Changed characters outside of the new window
+	are dropped from the resident ones */
+	end = off + f->width;
+	if(from < off)
+	{
+		f->res = f->res_end = off;
 	}
-	else
+	else if(from < f->res_end && hi > end && f->res_end > end)
 	{
-		lcd_cursor(f->col + f->width - 1, f->row);
-		lcd_data(' ');
-
-		lcd_cursor(f->col, f->row);
-		for(i = f->pos - (f->width - 1);
-			i < f->pos + 1 && f->buf[i]; ++i)
-		{
-			lcd_data(f->buf[i]);
-		}
-
-		lcd_cursor(f->col + f->width - 1, f->row);
+		f->res_end = from > end ? from : end;
 	}
-}
 
-/* Term Field */
-static void field_term_delete(Field *f)
-{
-	if(f->pos > 0)
+	if((d = off - f->off))
 	{
-		uint8_t n = 1, a;
-		a = f->buf[f->pos - 1];
-		if(a == CHAR_X)
+		if(f->cap == f->width || d >= f->width || d <= -f->width)
 		{
-			--x_cnt;
+			/* Map the new window to the visible columns */
+			f->base += d;
+			f->res = f->res_end = off;
 		}
-		else if(a == CHAR_LP)
+		else
 		{
-			for(++n; islower(f->buf[f->pos - n]); ++n) ;
-			--n;
+			for(; d > 0; --d)
+			{
+				lcd_command(LCD_SET_SHIFT | LCD_DISPLAY_SHIFT |
+					LCD_SHIFT_LEFT);
+			}
+
+			for(; d < 0; ++d)
+			{
+				lcd_command(LCD_SET_SHIFT | LCD_DISPLAY_SHIFT |
+					LCD_SHIFT_RIGHT);
+			}
 		}
 
-		field_shrink(f, n);
-		f->pos -= n;
-		f->len -= n;
-		f->buf[f->len] = '\0';
-		field_update(f);
+		f->off = off;
 	}
-}
 
-static void field_term_mv_left(Field *f)
-{
-	if(f->pos > 0)
+	if(f->res > end || f->res_end < off)
 	{
-		--(f->pos);
-		if(f->buf[f->pos] == CHAR_LP)
-		{
-			--(f->pos);
-			for(; islower(f->buf[f->pos]); --(f->pos)) ;
-			++(f->pos);
-		}
+		f->res = f->res_end = off;
 	}
-	else
+
+	/* Changed characters inside the resident ones */
+	a = from > f->res ? from : f->res;
+	b = hi < f->res_end ? hi : f->res_end;
+	if(b > end)
 	{
-		f->pos = f->len;
+		b = end;
 	}
 
-	field_update(f);
-}
+	if(a < b)
+	{
+		field_put(f, a, b);
+	}
 
-static void field_term_mv_right(Field *f)
-{
-	if(f->pos < f->len)
+	/* Bring the rest of the window into DDRAM, each new
+	column replaces the character cap columns away */
+	if(f->res > off)
 	{
-		if(f->buf[f->pos] != CHAR_X)
+		field_put(f, off, f->res);
+		f->res = off;
+		if(f->res_end > off + f->cap)
 		{
-			while(islower(f->buf[f->pos]))
-			{
-				++(f->pos);
-			}
+			f->res_end = off + f->cap;
 		}
-
-		++(f->pos);
 	}
-	else
+
+	if(f->res_end < end)
 	{
-		f->pos = 0;
+		field_put(f, f->res_end, end);
+		f->res_end = end;
+		if(f->res < end - f->cap)
+		{
+			f->res = end - f->cap;
+		}
 	}
 
-	field_update(f);
+	lcd_cursor(f->col + field_col(f, f->cpos), f->row);
 }
 
-/* Number Field */
-static void field_number_event(Field *f, uint8_t key)
+static void field_redraw(Field *f)
 {
-	switch(key)
-	{
-	case KEY_0_0:
-		field_ins_chr(f, '1');
-		break;
-
-	case KEY_0_1:
-		field_ins_chr(f, '4');
-		break;
-
-	case KEY_0_2:
-		field_ins_chr(f, '7');
-		break;
-
-	case KEY_1_0:
-		field_ins_chr(f, '2');
-		break;
+	/* After lcd_clear, which also resets the display shift */
+	f->base = f->off;
+	f->res = f->res_end = f->off;
+	f->drawn = 0;
+	field_update(f, FIELD_UNCHANGED);
+}
 
-	case KEY_1_1:
-		field_ins_chr(f, '5');
-		break;
+static void field_put(Field *f, int16_t i, int16_t end)
+{
+	/* Write the display columns [i, end). The character at a column
+	is found by walking from the cursor, whose column is known. */
+	int16_t p = f->pos, k = f->cpos;
+	uint8_t c = field_col(f, i);
+	while(k > i)
+	{
+		k -= field_chr_width(f->buf[--p]);
+	}
 
-	case KEY_1_2:
-		field_ins_chr(f, '8');
-		break;
+	while(p < f->len && k + field_chr_width(f->buf[p]) <= i)
+	{
+		k += field_chr_width(f->buf[p++]);
+	}
 
-	case KEY_1_3:
-		field_ins_chr(f, '0');
-		break;
+	k = i - k;
+	lcd_cursor(f->col + c, f->row);
+	for(; i < end; ++i)
+	{
+		if(c == f->cap)
+		{
+			c = 0;
+			lcd_cursor(f->col, f->row);
+		}
 
-	case KEY_2_0:
-		field_ins_chr(f, '3');
-		break;
+		if(p < f->len)
+		{
+			lcd_data(field_chr(f->buf[p], k));
+			if(++k == field_chr_width(f->buf[p]))
+			{
+				k = 0;
+				++p;
+			}
+		}
+		else
+		{
+			lcd_data(' ');
+		}
 
-	case KEY_2_1:
-		field_ins_chr(f, '6');
-		break;
+		++c;
+	}
+}
 
-	case KEY_2_2:
-		field_ins_chr(f, '9');
-		break;
+static uint8_t field_col(Field *f, int16_t i)
+{
+	/* DDRAM column of display column i, relative to the field */
+	int16_t c = (i - f->base) % f->cap;
+	return c < 0 ? c + f->cap : c;
+}
 
-	case KEY_3_0:
-		field_clear(f);
-		break;
+static uint8_t field_chr_width(uint8_t c)
+{
+	if(IS_FUNC(c))
+	{
+		return strlen_P((const char *)pgm_read_word(
+			_func_names + c - TT_LOG));
+	}
 
-	case KEY_3_1:
-		field_delete(f);
-		break;
+	return 1;
+}
 
-	case KEY_3_2:
-		field_ins_chr(f, CHAR_DP);
-		break;
+static uint8_t field_chr(uint8_t c, uint8_t k)
+{
+	/* Character k of the text shown for c */
+	if(IS_FUNC(c))
+	{
+		return pgm_read_byte((const uint8_t *)pgm_read_word(
+			_func_names + c - TT_LOG) + k);
+	}
 
-	case KEY_SHIFT_0_1:
-		/* left */
-		field_mv_left(f);
-		break;
+	return c;
+}
 
-	case KEY_SHIFT_2_1:
-		/* right */
-		field_mv_right(f);
-		break;
+/* Term Field */
+static void field_term_delete(Field *f)
+{
+	if(f->pos > 0 && (f->buf[f->pos - 1] == CHAR_X ||
+		f->buf[f->pos - 1] == CHAR_Y))
+	{
+		--x_cnt;
 	}
+
+	field_delete(f);
 }
 
 /* Input Mode */
@@ -589,376 +1441,1764 @@ static void mode_input(void)
 	lcd_clear();
 	lcd_command(LCD_SET_DISPLAY | LCD_DISPLAY_ON |
 		LCD_CURSOR_ON | LCD_BLINKING_OFF);
-	field_update(&fld_term);
+	field_redraw(&fld_term);
 }
 
 static void mode_input_event(uint8_t key)
 {
-	switch(key)
+	if(key_alt)
 	{
-	case KEY_0_0:
-		field_ins_chr(&fld_term, '1');
-		break;
-
-	case KEY_0_1:
-		field_ins_chr(&fld_term, '4');
-		break;
+		key_dispatch(_keys_alt_P, &fld_term, UNSHIFT(key));
+		return;
+	}
 
-	case KEY_0_2:
-		field_ins_chr(&fld_term, '7');
-		break;
+	key_dispatch(_keys_input_P, &fld_term, key);
+}
 
-	case KEY_0_3:
-		field_ins_chr(&fld_term, CHAR_LP);
-		break;
+/* Result Mode */
+static void mode_result(const uint8_t *s)
+{
+	/* The display may be shifted by the term field,
+	the visible part of row 1 can wrap around in DDRAM */
+	uint8_t c;
+	_event = mode_result_event;
+	c = field_col(&fld_term, fld_term.off);
+	lcd_cursor(c, 1);
+	for(; *s; ++s)
+	{
+		if(c == LCD_DDRAM_WIDTH)
+		{
+			c = 0;
+			lcd_cursor(0, 1);
+		}
 
-	case KEY_1_0:
-		field_ins_chr(&fld_term, '2');
-		break;
+		lcd_data(*s);
+		++c;
+	}
 
-	case KEY_1_1:
-		field_ins_chr(&fld_term, '5');
-		break;
+	lcd_cursor(field_col(&fld_term, fld_term.cpos), 0);
+}
 
-	case KEY_1_2:
-		field_ins_chr(&fld_term, '8');
-		break;
+static void mode_result_event(uint8_t key)
+{
+	mode_input();
+	mode_input_event(key);
+}
 
-	case KEY_1_3:
-		field_ins_chr(&fld_term, '0');
-		break;
+/* Table Mode */
+static void mode_table(void)
+{
+#if CALC_Y2
+	if(calc_sep == CALC_SEP_NONE)
+	{
+		tbl_view = 0;
+	}
+#endif
 
-	case KEY_2_0:
-		field_ins_chr(&fld_term, '3');
-		break;
+	_event = mode_table_event;
+	lcd_command(LCD_SET_DISPLAY | LCD_DISPLAY_ON |
+		LCD_CURSOR_OFF | LCD_BLINKING_OFF);
+	mode_table_update();
+}
 
-	case KEY_2_1:
-		field_ins_chr(&fld_term, '6');
-		break;
+static void mode_table_event(uint8_t key)
+{
+	key_dispatch(_keys_table_P, 0, UNSHIFT(key));
+}
 
-	case KEY_2_2:
-		field_ins_chr(&fld_term, '9');
-		break;
+static void mode_table_update(void)
+{
+	num_t x, y;
+	uint8_t *s = 0, col, err;
+	int32_t n;
+	const Axis *a = &tbl;
+#if CALC_XY
+	uint8_t var = tbl_var;
+	if(tbl_fix)
+	{
+		a = &tbl_fixed;
+		var ^= CHAR_X ^ CHAR_Y;
+	}
+#endif
 
-	case KEY_2_3:
-		field_ins_chr(&fld_term, CHAR_RP);
-		break;
+	if(a->exact)
+	{
+		/* The label is printed from the integer row value,
+		negated in 32 bits unsigned so INT32_MIN works too */
+		n = a->x0 + a->pos * a->dx;
+		s = num_fixed(n < 0 ? -(uint32_t)n : (uint32_t)n, n < 0, a->exp,
+			_buf_conv, 14);
+	}
 
-	case KEY_3_0:
-		field_clear(&fld_term);
-		x_cnt = 0;
-		break;
+	y = 0;
 
-	case KEY_3_1:
-		field_term_delete(&fld_term);
-		break;
+	/* Print X, or Y when moving along y or showing the fixed y */
+	lcd_cursor(0, 0);
+#if CALC_XY
+	lcd_data(var == CHAR_Y ? 'Y' : 'X');
+#else
+	lcd_data('X');
+#endif
+	lcd_data('=');
+	lcd_string(s ? s : FORMAT_NUMBER(tbl_x(a, a->pos), _buf_conv, 14));
+	x = tbl_x(&tbl, tbl.pos);
 
-	case KEY_3_2:
-		field_ins_chr(&fld_term, CHAR_DP);
-		break;
+	col = tbl_label(_buf_conv);
+	lcd_cursor(0, 1);
+	lcd_string(_buf_conv);
+#if CALC_DUAL
+	if(tbl_deriv)
+	{
+		/* Y'= f'(x), from the same pass as f(x) */
+		num_t v[CALC_FUNCS], d[CALC_FUNCS];
+		err = tbl_pick(d, calc_solve_dual(x, v, d), &y);
+	}
+	else
+#endif
+	{
+		err = tbl_solve(x, &y);
+	}
 
-	case KEY_3_3:
+	if(err)
 	{
-		/* enter */
-		uint8_t err;
-		float y = 0;
-		if((err = calc_prepare(buf_term)))
+		/* Do not go into error mode when in table mode, because
+		often functions are undefined for some x values. e.g.
+		f(0) = 1 / x = NaN
+		Print "ERROR" for y instead. */
+		uint8_t i;
+		for(i = col; i < LCD_WIDTH - MSG_ERROR_LEN; ++i)
 		{
-			mode_error(err);
+			lcd_data(' ');
+		}
+
+		lcd_string_P(_str_error);
+	}
+	else
+	{
+		/* Print Y */
+		lcd_string(FORMAT_NUMBER(y, _buf_conv, LCD_WIDTH - col));
+	}
+}
+
+static uint8_t tbl_label(uint8_t *s)
+{
+	/* Y=, Y'= or with a second function Y1=, Y2= and Y1-Y2=,
+	returns the length. F instead of Y when the term has y. */
+	uint8_t *p = s, i, n = 1;
+#if CALC_Y2
+	if(tbl_view == 2)
+	{
+		n = 2;
+	}
+#endif
+
+	for(i = 0; i < n; ++i)
+	{
+		if(i)
+		{
+			*p++ = CHAR_SUB;
+		}
+
+#if CALC_XY
+		*p++ = calc_y ? 'F' : 'Y';
+#else
+		*p++ = 'Y';
+#endif
+#if CALC_Y2
+		if(calc_sep != CALC_SEP_NONE)
+		{
+			*p++ = i || tbl_view == 1 ? '2' : '1';
+		}
+#endif
+#if CALC_DUAL
+		if(tbl_deriv)
+		{
+			*p++ = '\'';
+		}
+#endif
+	}
+
+	*p++ = '=';
+	*p = '\0';
+	return p - s;
+}
+
+static num_t tbl_x(const Axis *a, int32_t pos)
+{
+	num_t x;
+	if(a->exact)
+	{
+		/* Integer row, scaled by a power of ten only once,
+		so every x is the closest num_t to the exact value */
+		int32_t n = a->x0 + pos * a->dx;
+		x = num_scale(n < 0 ? -(uint32_t)n : (uint32_t)n, a->exp, 0);
+		return n < 0 ? -x : x;
+	}
+
+	return a->start + pos * a->step;
+}
+
+static uint8_t tbl_solve(num_t x, num_t *y)
+{
+	/* Y1 and Y2 come from one pass over both programs */
+	num_t v[CALC_FUNCS];
+	return tbl_pick(v, calc_solve(x, v), y);
+}
+
+static uint8_t tbl_pick(const num_t *v, uint8_t err, num_t *y)
+{
+	/* The row selected by tbl_view from the results
+	of Y1 and Y2, err is the one of Y1 */
+#if CALC_Y2
+	if(tbl_view)
+	{
+		*y = tbl_view == 1 ? v[1] : v[0] - v[1];
+		return isfinite(*y) ? 0 : ERROR_MATH;
+	}
+#endif
+
+	*y = v[0];
+	return err;
+}
+
+#if CALC_SUM || CALC_ITER || CALC_STAT
+static void lcd_uint(uint32_t n, uint8_t width)
+{
+	/* Right aligned, all nines if it does not fit */
+	uint8_t i, len;
+	ultoa(n, (char *)_buf_conv, 10);
+	if((len = strlen((char *)_buf_conv)) > width)
+	{
+		memset(_buf_conv, '9', width);
+		_buf_conv[width] = '\0';
+		len = width;
+	}
+
+	for(i = len; i < width; ++i)
+	{
+		lcd_data(' ');
+	}
+
+	lcd_string(_buf_conv);
+}
+#endif
+
+/* Sum Mode */
+#if CALC_SUM
+static void mode_sum(void)
+{
+	/* Sum of the rows from 0 to the current one in the background.
+	On row 0 all rows from 0 on are summed until the terms are too
+	small to change the sum. */
+	sum_s = 0;
+	sum_c = 0;
+	sum_n = 0;
+	sum_ticks = 0;
+	sum_pos = 0;
+	sum_small = 0;
+	sum_done = 0;
+	sum_err = 0;
+	sum_open = !tbl.pos;
+	sum_end = sum_open ? tbl.pos_max : tbl.pos;
+	sum_total = (sum_end < 0 ? -sum_end : sum_end) + 1;
+
+	_event = mode_sum_event;
+	lcd_clear();
+	lcd_data(CHAR_SIGMA);
+	sum_run(1);
+	sum_show();
+}
+
+static void mode_sum_event(uint8_t key)
+{
+	key_dispatch(_keys_sum_P, 0, UNSHIFT(key));
+}
+
+static void sum_run(uint8_t on)
+{
+	/* Paused time does not count for the terms per second */
+	sum_last = ticks;
+	sum_shown = 0;
+	_job = on ? sum_job : 0;
+}
+
+static void sum_job(void)
+{
+	/* Terms until the next tick, so a key waits at most one tick.
+	Neumaier summation: the low order bits that get lost when
+	adding a term are collected in sum_c. */
+	uint8_t t = ticks, d;
+	num_t v, s;
+	do
+	{
+		if(tbl_solve(tbl_x(&tbl, sum_pos), &v))
+		{
+			sum_err = 1;
+			sum_done = 1;
 			break;
 		}
 
-		err = calc_solve(0, &y);
-		if(x_cnt)
+		s = sum_s + v;
+		sum_c += fabs(sum_s) >= fabs(v) ?
+			(sum_s - s) + v : (v - s) + sum_s;
+
+		/* sum_c is a plain sum of the errors and would lose digits
+		itself over many terms, so the part of it that sum_s can
+		represent is moved there */
+		sum_s = s + sum_c;
+		sum_c -= sum_s - s;
+		++sum_n;
+
+		if(sum_open)
 		{
-			if(err && err != ERROR_MATH)
+			if(fabs(v) > SUM_EPS * fabs(s + sum_c))
 			{
-				mode_error(err);
-				break;
+				sum_small = 0;
 			}
+			else if(++sum_small == SUM_TAIL)
+			{
+				sum_done = 1;
+			}
+		}
 
-			mode_settings();
+		if(sum_pos == sum_end)
+		{
+			sum_done = 1;
 		}
 		else
 		{
-			if(err)
-			{
-				mode_error(err);
-				break;
-			}
+			sum_pos += sum_end < 0 ? -1 : 1;
+		}
+	}
+	while(!sum_done && ticks == t);
+
+	d = ticks - sum_last;
+	sum_last += d;
+	sum_ticks += d;
+	sum_shown += d;
+	if(sum_done)
+	{
+		_job = 0;
+		sum_show();
+	}
+	else if(sum_shown >= SUM_SHOW_TICKS)
+	{
+		sum_shown = 0;
+		sum_show();
+	}
+}
+
+static void sum_show(void)
+{
+	/* Progress in percent or the number of terms, the terms
+	per second and the sum so far */
+	lcd_cursor(1, 0);
+	if(sum_open)
+	{
+		lcd_uint(sum_n, 8);
+	}
+	else
+	{
+		lcd_uint((uint32_t)((num_t)sum_n * 100 / sum_total), 7);
+		lcd_data('%');
+	}
 
-			mode_result(y);
+	lcd_uint(sum_ticks ?
+		(uint32_t)((num_t)sum_n * KEY_SCAN_HZ / sum_ticks) : 0, 5);
+	lcd_data('/');
+	lcd_data('s');
+
+	lcd_cursor(0, 1);
+	if(sum_err)
+	{
+		uint8_t i;
+		for(i = 0; i < LCD_WIDTH - MSG_ERROR_LEN; ++i)
+		{
+			lcd_data(' ');
 		}
-		break;
+
+		lcd_string_P(_str_error);
+	}
+	else
+	{
+		lcd_string(FORMAT_NUMBER(sum_s + sum_c, _buf_conv, LCD_WIDTH));
 	}
+}
+#endif
 
-	case KEY_SHIFT_0_0:
-		field_ins_str_P(&fld_term, _str_sin, 3);
-		break;
+/* Iteration Mode */
+#if CALC_ITER
+static void mode_iter(void)
+{
+	/* u(0) is x of the current row */
+	iter_u = iter_save = tbl_x(&tbl, tbl.pos);
+	iter_n = 0;
+	iter_lam = 0;
+	iter_pow = 1;
+	iter_state = ITER_RUN;
+	_event = mode_iter_event;
+	lcd_clear();
+	mode_iter_update();
+}
 
-	case KEY_SHIFT_0_1:
-		field_term_mv_left(&fld_term);
-		break;
+static void mode_iter_event(uint8_t key)
+{
+	key_dispatch(_keys_iter_P, 0, UNSHIFT(key));
+}
 
-	case KEY_SHIFT_0_2:
-		field_ins_chr(&fld_term, CHAR_X);
-		++x_cnt;
-		break;
+static void mode_iter_update(void)
+{
+	/* N=steps, FIXED or P=period of the cycle, U=u(n) */
+	lcd_cursor(0, 0);
+	lcd_data('N');
+	lcd_data('=');
+	lcd_uint(iter_n, 8);
+	if(iter_state == ITER_FIXED)
+	{
+		lcd_string_P(_str_fixed);
+	}
+	else if(iter_state == ITER_CYCLE)
+	{
+		lcd_data(' ');
+		lcd_data('P');
+		lcd_data('=');
+		lcd_uint(iter_lam, 3);
+	}
+	else
+	{
+		uint8_t i;
+		for(i = 0; i < MSG_FIXED_LEN; ++i)
+		{
+			lcd_data(' ');
+		}
+	}
 
-	case KEY_SHIFT_0_3:
-		field_ins_str_P(&fld_term, _str_asin, 4);
-		break;
+	lcd_cursor(0, 1);
+	lcd_data('U');
+	lcd_data('=');
+	if(iter_state == ITER_ERROR)
+	{
+		uint8_t i;
+		for(i = 2; i < LCD_WIDTH - MSG_ERROR_LEN; ++i)
+		{
+			lcd_data(' ');
+		}
 
-	case KEY_SHIFT_1_0:
-		field_ins_str_P(&fld_term, _str_cos, 3);
-		break;
+		lcd_string_P(_str_error);
+	}
+	else
+	{
+		lcd_string(FORMAT_NUMBER(iter_u, _buf_conv, LCD_WIDTH - 2));
+	}
+}
+#endif
 
-	case KEY_SHIFT_1_1:
-		field_ins_chr(&fld_term, CHAR_PI);
-		break;
+/* Statistics Mode */
+#if CALC_STAT
+static void mode_stat(void)
+{
+	_mode = mode_stat;
+	_event = mode_stat_event;
+	lcd_clear();
+	lcd_command(LCD_SET_DISPLAY | LCD_DISPLAY_ON |
+		LCD_CURSOR_ON | LCD_BLINKING_OFF);
+	lcd_cursor(0, 1);
+	lcd_data('X');
+	lcd_data('=');
+	field_redraw(&fld_stat);
+	mode_stat_update();
+}
 
-	case KEY_SHIFT_1_2:
-		field_ins_chr(&fld_term, CHAR_POW);
-		break;
+static void mode_stat_event(uint8_t key)
+{
+	if(_job)
+	{
+		/* A key stops adding the table rows,
+		the ones added so far stay */
+		_job = 0;
+		mode_stat_update();
+		return;
+	}
 
-	case KEY_SHIFT_1_3:
-		field_ins_str_P(&fld_term, _str_acos, 4);
-		break;
+	key_dispatch(_keys_stat_P, &fld_stat, key);
+}
 
-	case KEY_SHIFT_2_0:
-		field_ins_str_P(&fld_term, _str_tan, 3);
-		break;
+static void mode_stat_update(void)
+{
+	/* The selected statistic on row 0, then back to the field */
+	const uint8_t *s;
+	uint8_t col, i;
+	num_t v;
+	s = (const uint8_t *)pgm_read_word(_stat_label + stat_view);
+	col = strlen_P((const char *)s);
+	lcd_cursor(0, 0);
+	lcd_string_P(s);
+	if(stat_view == STAT_N)
+	{
+		lcd_uint(stat_n, LCD_WIDTH - col);
+	}
+	else if(stat_value(&v))
+	{
+		for(i = col; i < LCD_WIDTH - MSG_ERROR_LEN; ++i)
+		{
+			lcd_data(' ');
+		}
 
-	case KEY_SHIFT_2_1:
-		field_term_mv_right(&fld_term);
-		break;
+		lcd_string_P(_str_error);
+	}
+	else
+	{
+		lcd_string(FORMAT_NUMBER(v, _buf_conv, LCD_WIDTH - col));
+	}
 
-	case KEY_SHIFT_2_2:
-		field_ins_str_P(&fld_term, _str_log, 3);
-		break;
+	field_update(&fld_stat, FIELD_UNCHANGED);
+}
 
-	case KEY_SHIFT_2_3:
-		field_ins_str_P(&fld_term, _str_atan, 4);
-		break;
+static void stat_add(num_t x)
+{
+	/* Welford's update, the mean moves by a fraction of the difference
+	and m2 grows by the product of the differences before and after.
+	Unlike a sum of squares this does not cancel for a large mean. */
+	num_t d = x - stat_mean;
+	stat_mean += d / ++stat_n;
+	stat_m2 += d * (x - stat_mean);
+	if(stat_n == 1 || x < stat_min)
+	{
+		stat_min = x;
+	}
+
+	if(stat_n == 1 || x > stat_max)
+	{
+		stat_max = x;
+	}
+}
+
+static uint8_t stat_value(num_t *v)
+{
+	/* The sample variance needs two samples */
+	if(!stat_n || (stat_n == 1 &&
+		(stat_view == STAT_VAR || stat_view == STAT_SD)))
+	{
+		return ERROR_MATH;
+	}
 
-	case KEY_SHIFT_3_0:
-		field_ins_chr(&fld_term, CHAR_ADD);
+	switch(stat_view)
+	{
+	case STAT_MEAN:
+		*v = stat_mean;
 		break;
 
-	case KEY_SHIFT_3_1:
-		field_ins_chr(&fld_term, CHAR_SUB);
+	case STAT_VAR:
+		*v = stat_m2 / (stat_n - 1);
 		break;
 
-	case KEY_SHIFT_3_2:
-		field_ins_chr(&fld_term, CHAR_MUL);
+	case STAT_SD:
+		*v = sqrt(stat_m2 / (stat_n - 1));
 		break;
 
-	case KEY_SHIFT_3_3:
-		field_ins_chr(&fld_term, CHAR_DIV);
+	case STAT_MIN:
+		*v = stat_min;
 		break;
 
-	default:
+	case STAT_MAX:
+		*v = stat_max;
 		break;
 	}
+
+	return isfinite(*v) ? 0 : ERROR_MATH;
 }
 
-/* Result Mode */
-static void mode_result(float y)
+static void stat_table_job(void)
 {
-	_event = mode_result_event;
-	lcd_cursor(0, 1);
-	lcd_string(FORMAT_NUMBER(y, _buf_conv, sizeof(_buf_conv) - 1));
-	lcd_cursor(fld_term.pos < LCD_WIDTH - 1 ?
-		fld_term.pos : LCD_WIDTH - 1, 0);
+	/* Rows until the next tick, like sum_job,
+	rows where y is undefined are skipped */
+	uint8_t t = ticks, last;
+	num_t y;
+	do
+	{
+		if(!tbl_solve(tbl_x(&tbl, stat_pos), &y))
+		{
+			stat_add(y);
+		}
+
+		last = stat_pos == stat_end;
+		stat_pos += stat_end < 0 ? -1 : 1;
+	}
+	while(!last && ticks == t);
+
+	if(last)
+	{
+		_job = 0;
+		mode_stat_update();
+	}
+	else if((stat_shown += (uint8_t)(ticks - t)) >= STAT_SHOW_TICKS)
+	{
+		stat_shown = 0;
+		stat_table_show();
+	}
 }
 
-static void mode_result_event(uint8_t key)
+static void stat_table_show(void)
 {
-	mode_input();
-	mode_input_event(key);
+	/* Rows added in percent on row 0 instead of the statistic */
+	lcd_cursor(0, 0);
+	lcd_uint((uint32_t)((num_t)(stat_pos < 0 ? -stat_pos : stat_pos) *
+		100 / ((num_t)(stat_end < 0 ? -stat_end : stat_end) + 1)),
+		LCD_WIDTH - 1);
+	lcd_data('%');
+	field_update(&fld_stat, FIELD_UNCHANGED);
 }
+#endif
 
-/* Table Mode */
-static void mode_table(void)
+/* Settings Mode */
+static void mode_settings(void)
 {
-	tbl_pos = 0;
-	_event = mode_table_event;
+	_mode = mode_settings;
+	_event = mode_settings_event;
+	tbl_cur_fld = &fld_start;
 	lcd_command(LCD_SET_DISPLAY | LCD_DISPLAY_ON |
-		LCD_CURSOR_OFF | LCD_BLINKING_OFF);
-	lcd_cursor(0, 0);
-	lcd_data('X');
-	lcd_data('=');
-	lcd_cursor(0, 1);
-	lcd_data('Y');
-	lcd_data('=');
-	mode_table_update();
+		LCD_CURSOR_ON | LCD_BLINKING_OFF);
+	mode_settings_page(0);
 }
 
-static void mode_table_event(uint8_t key)
+static void mode_settings_event(uint8_t key)
 {
-	switch(UNSHIFT(key))
-	{
-	case KEY_0_0:
+	key_dispatch(_keys_settings_P, tbl_cur_fld, key);
+}
+
+static void mode_settings_page(uint8_t p)
+{
+	/* Start and step of x, or on page 1 of y */
+	lcd_clear();
+#if CALC_XY
+	if(p)
+	{
+		lcd_string_P(_str_ystart);
+		lcd_cursor(0, 1);
+		lcd_string_P(_str_ystep);
+		field_redraw(&fld_ystep);
+		field_redraw(&fld_ystart);
+		return;
+	}
+#endif
+
+	lcd_string_P(_str_start);
+	lcd_cursor(0, 1);
+	lcd_string_P(_str_step);
+	field_redraw(&fld_step);
+	field_redraw(&fld_start);
+}
+
+static uint8_t tbl_setup(void)
+{
+#if CALC_XY
+	/* x moves first, y stays at its start */
+	uint8_t err;
+	tbl_var = CHAR_X;
+	tbl_fix = 0;
+	if((calc_y && (err = tbl_axis(&tbl_fixed, buf_ystart, buf_ystep))) ||
+		(err = tbl_axis(&tbl, buf_start, buf_step)))
+	{
+		return err;
+	}
+
+	return tbl_fold();
+#else
+	return tbl_axis(&tbl, buf_start, buf_step);
+#endif
+}
+
+static uint8_t tbl_axis(Axis *a, uint8_t *start, uint8_t *step)
+{
+	/* an empty start value defaults to 0.0 */
+	mant_t ms = 0, md;
+	int16_t es = 0, ed;
+	uint8_t ns = 0, nd, err, *rs = 0, *rd;
+	if((*start && (err = num_parse(start, &ms, &es, &ns, &rs))) ||
+		(err = num_parse(step, &md, &ed, &nd, &rd)))
+	{
+		return err;
+	}
+
+	/* step must not be zero */
+	if(md == 0)
+	{
+		return ERROR_RANGE;
+	}
+
+	a->pos = 0;
+	a->start = num_scale(ms, es, rs);
+	a->step = num_scale(md, ed, rd);
+	if(ns)
+	{
+		a->start = -a->start;
+	}
+
+	if(nd)
+	{
+		a->step = -a->step;
+	}
+
+	/* Bring start and step to the same decimal exponent */
+	a->exp = es < ed ? es : ed;
+	if((a->exact = tbl_align(&ms, es - a->exp) &&
+		tbl_align(&md, ed - a->exp)))
+	{
+		a->x0 = ns ? -(int32_t)ms : (int32_t)ms;
+		a->dx = nd ? -(int32_t)md : (int32_t)md;
+		a->pos_max = (INT32_MAX - (int32_t)ms) / (int32_t)md;
+	}
+
+	/* So the distance between two rows always fits int32_t */
+	if(!a->exact || a->pos_max > INT32_MAX / 2)
+	{
+		a->pos_max = INT32_MAX / 2;
+	}
+
+	return 0;
+}
+
+static uint8_t tbl_align(mant_t *m, int16_t n)
+{
+	/* Multiply by 10^n, fails if the result does not fit int32_t */
+	for(; n > 0; --n)
+	{
+		if(*m > INT32_MAX / 10)
+		{
+			return 0;
+		}
+
+		*m *= 10;
+	}
+
+	return *m <= INT32_MAX;
+}
+
+#if CALC_XY
+static uint8_t tbl_fold(void)
+{
+	/* Compile the term again and evaluate everything that only
+	depends on the fixed variable, at its current row */
+	uint8_t err;
+	if((err = calc_prepare(buf_term)))
+	{
+		return err;
+	}
+
+	return calc_fold(tbl_var, calc_y ? tbl_x(&tbl_fixed, tbl_fixed.pos) : 0);
+}
+#endif
+
+/* Angle Mode */
+static void mode_angle(void)
+{
+	lcd_clear();
+	lcd_command(LCD_SET_DISPLAY | LCD_DISPLAY_ON |
+		LCD_CURSOR_OFF | LCD_BLINKING_OFF);
+	lcd_string_P(_str_angle);
+	lcd_string_P((uint8_t *)pgm_read_word(_angle_name + calc_angle));
+	_event = mode_angle_event;
+	lcd_cursor(0, 1);
+	lcd_string_P(_str_press_any_key);
+}
+
+static void mode_angle_event(uint8_t key)
+{
+	/* The angle key selects the next unit, any other key compiles
+	the term again with it and goes on like = in input mode */
+	key_dispatch(_keys_angle_P, &fld_term, UNSHIFT(key));
+}
+
+/* Error Mode */
+static void mode_error(uint8_t err)
+{
+	lcd_clear();
+	lcd_command(LCD_SET_DISPLAY | LCD_DISPLAY_ON |
+		LCD_CURSOR_OFF | LCD_BLINKING_OFF);
+	lcd_string_P((uint8_t *)pgm_read_word(_err_msg + err - 1));
+	_event = mode_error_event;
+	lcd_cursor(0, 1);
+	lcd_string_P(_str_press_any_key);
+}
+
+static void mode_error_event(uint8_t key)
+{
+	_mode();
+}
+
+/* Key Actions */
+static void key_dispatch(const KeyMap *map, Field *f, uint8_t key)
+{
+	/* Constant time lookup of the action in the key map of the mode,
+	then an indirect call of its handler with the argument */
+	uint8_t a = pgm_read_byte(&map[key].action);
+	if(a != KA_NONE)
+	{
+		((void (*)(Field *, uint8_t))pgm_read_word(
+			_key_actions + a - 1))(f, pgm_read_byte(&map[key].arg));
+	}
+}
+
+static void key_edit(Field *f, uint8_t op)
+{
+	switch(op)
+	{
+	case EDIT_CLEAR:
+		field_clear(f);
+		break;
+
+	case EDIT_DELETE:
+		field_delete(f);
+		break;
+
+	case EDIT_LEFT:
+		field_mv_left(f);
+		break;
+
+	case EDIT_RIGHT:
+		field_mv_right(f);
+		break;
+
+	case EDIT_TERM_CLEAR:
+		field_clear(f);
+		x_cnt = 0;
+		break;
+
+	case EDIT_TERM_DELETE:
+		field_term_delete(f);
+		break;
+	}
+}
+
+static void key_x(Field *f, uint8_t arg)
+{
+#if CALC_XY
+	/* x directly before the cursor becomes y and y becomes x again,
+	two variables next to each other are not valid anyway */
+	uint8_t c = f->pos > 0 ? f->buf[f->pos - 1] : 0;
+	if(c == CHAR_X || c == CHAR_Y)
+	{
+		field_delete(f);
+		field_ins_chr(f, c ^ CHAR_X ^ CHAR_Y);
+		return;
+	}
+#endif
+
+	field_ins_chr(f, CHAR_X);
+	++x_cnt;
+}
+
+static void key_solve(Field *f, uint8_t arg)
+{
+	/* enter in input mode */
+	uint8_t err;
+	num_t y[CALC_FUNCS];
+	if((err = calc_prepare(buf_term)))
+	{
+		mode_error(err);
+		return;
+	}
+
+#if CALC_Y2
+	if(x_cnt || calc_sep != CALC_SEP_NONE)
+#else
+	if(x_cnt)
+#endif
+	{
+		mode_settings();
+		return;
+	}
+
+#if CALC_DECIMAL
+	if(calc_exact)
+	{
+		if(!(err = dec_solve(buf_term, _buf_conv,
+			sizeof(_buf_conv) - 1)))
+		{
+			mode_result(_buf_conv);
+			return;
+		}
+
+		if(err == ERROR_MATH)
+		{
+			mode_error(err);
+			return;
+		}
+
+		/* Out of range of the decimal engine, use num_t */
+	}
+#endif
+
+	if((err = calc_solve(0, y)))
+	{
+		mode_error(err);
+		return;
+	}
+
+	mode_result(FORMAT_NUMBER(y[0], _buf_conv, sizeof(_buf_conv) - 1));
+}
+
+static void key_enter(Field *f, uint8_t mode)
+{
+	/* escape to input, degrees, radians or grad, back to the row
+	from sum and iteration mode, sum up to and iterate from the
+	current row. A running background job ends with its mode. */
+	_job = 0;
+	switch(mode)
+	{
+	case ENTER_INPUT:
 		mode_input();
 		break;
 
-	case KEY_0_1:
-		/* left arrow */
-		tbl_pos -= MODE_TABLE_STEP_BIG;
-		mode_table_update();
-		break;
+	case ENTER_ANGLE:
+		mode_angle();
+		break;
+
+#if CALC_SUM || CALC_ITER
+	case ENTER_TABLE:
+		mode_table();
+		break;
+#endif
+
+#if CALC_SUM
+	case ENTER_SUM:
+		mode_sum();
+		break;
+#endif
+
+#if CALC_ITER
+	case ENTER_ITER:
+		mode_iter();
+		break;
+#endif
+	}
+}
+
+static void key_angle(Field *f, uint8_t arg)
+{
+	/* next unit of the trigonometric functions */
+	if(++calc_angle == ANGLE_UNITS)
+	{
+		calc_angle = ANGLE_DEG;
+	}
+
+	mode_angle();
+}
+
+static void key_minus(Field *f, uint8_t arg)
+{
+	/* only start and samples can be negative */
+#if CALC_STAT
+	if(f == &fld_start || f == &fld_stat)
+#else
+	if(f == &fld_start)
+#endif
+	{
+		field_ins_chr(f, CHAR_SUB);
+	}
+}
+
+static void key_field(Field *f, uint8_t arg)
+{
+	/* up (0) and down (1) in settings mode */
+#if CALC_XY
+	/* With y, down from step and up from the start of y
+	switch between the pages of x and y */
+	uint8_t p = f == &fld_ystart || f == &fld_ystep;
+	if(calc_y && f->row == arg && p != arg)
+	{
+		mode_settings_page(arg);
+		tbl_cur_fld = arg ? &fld_ystart : &fld_step;
+		field_update(tbl_cur_fld, FIELD_UNCHANGED);
+		return;
+	}
+
+	if(p)
+	{
+		tbl_cur_fld = arg ? &fld_ystep : &fld_ystart;
+		field_update(tbl_cur_fld, FIELD_UNCHANGED);
+		return;
+	}
+#endif
+
+	tbl_cur_fld = arg ? &fld_step : &fld_start;
+	field_update(tbl_cur_fld, FIELD_UNCHANGED);
+}
+
+static void key_setup(Field *f, uint8_t arg)
+{
+	/* enter in settings mode */
+	uint8_t err;
+	if((err = tbl_setup()))
+	{
+		mode_error(err);
+		return;
+	}
+
+	mode_table();
+}
+
+static void key_move(Field *f, uint8_t d)
+{
+	/* Stay in the range where the row x can be computed */
+	int32_t pos = tbl.pos + (int8_t)d;
+	if(pos >= -tbl.pos_max && pos <= tbl.pos_max)
+	{
+		tbl.pos = pos;
+		mode_table_update();
+	}
+}
+
+static void key_reset(Field *f, uint8_t arg)
+{
+	tbl.pos = 0;
+	mode_table_update();
+}
+
+#if CALC_DUAL
+static void key_deriv(Field *f, uint8_t arg)
+{
+	/* toggle Y and Y' */
+	tbl_deriv ^= 1;
+	mode_table_update();
+}
+#endif
+
+#if CALC_INTERVAL
+static void key_search(Field *f, uint8_t arg)
+{
+	/* Move to the next row in direction arg where y changes its sign.
+	A block of rows whose y interval does not contain zero is skipped
+	as a whole and the next block is twice as long, otherwise the
+	block is halved down to a single row, which is checked with
+	calc_solve. Stops after MODE_TABLE_SEARCH_EVALS evaluations at the
+	row reached so far, so the key can be pressed again. */
+	Interval xi, yi[CALC_FUNCS];
+	num_t y0, y1;
+	int32_t n, m;
+	uint16_t i;
+	uint8_t e0, e1;
+	int8_t d = (int8_t)arg;
+	e0 = tbl_solve(tbl_x(&tbl, tbl.pos), &y0);
+	for(i = 0, n = 1; i < MODE_TABLE_SEARCH_EVALS; ++i)
+	{
+		/* Rows left until the end of the table */
+		if(!(m = tbl.pos_max - d * tbl.pos))
+		{
+			break;
+		}
+
+		if(n > m)
+		{
+			n = m;
+		}
+
+		if(n > 1)
+		{
+			iv_set(&xi, tbl_x(&tbl, tbl.pos),
+				tbl_x(&tbl, tbl.pos + d * n));
+			e1 = calc_solve_interval(&xi, yi);
+#if CALC_Y2
+			if(tbl_view == 1)
+			{
+				yi[0] = yi[1];
+			}
+			else if(tbl_view == 2)
+			{
+				iv_set(yi, yi[0].lo - yi[1].hi, yi[0].hi - yi[1].lo);
+				iv_widen(yi, IV_ULP_EXACT);
+			}
+#endif
+
+			if(!e1 && (yi[0].lo > 0 || yi[0].hi < 0))
+			{
+				tbl.pos += d * n;
+				y0 = yi[0].lo;
+				e0 = 0;
+				if(n < MODE_TABLE_SEARCH_BLOCK)
+				{
+					n *= 2;
+				}
+			}
+			else
+			{
+				n /= 2;
+			}
+
+			continue;
+		}
+
+		tbl.pos += d;
+		e1 = tbl_solve(tbl_x(&tbl, tbl.pos), &y1);
+		if(!e1 && (y1 == 0 || (!e0 && y0 != 0 && (y0 < 0) != (y1 < 0))))
+		{
+			break;
+		}
+
+		y0 = y1;
+		e0 = e1;
+		n = 2;
+	}
+
+	mode_table_update();
+}
+#endif
+
+#if CALC_Y2
+static void key_y2(Field *f, uint8_t arg)
+{
+	/* edit Y2, which follows the separator at the end of the term */
+	fld_term.pos = fld_term.len;
+	fld_term.cpos = fld_term.clen;
+	mode_input();
+	if(!strchr((char *)buf_term, CHAR_SEP))
+	{
+		field_ins_chr(&fld_term, CHAR_SEP);
+	}
+}
+
+static void key_view(Field *f, uint8_t arg)
+{
+	/* cycle Y1, Y2 and Y1 - Y2 */
+	if(calc_sep != CALC_SEP_NONE)
+	{
+		if(++tbl_view == 3)
+		{
+			tbl_view = 0;
+		}
+
+		mode_table_update();
+	}
+}
+#endif
+
+#if CALC_XY
+static void key_axis(Field *f, uint8_t fix)
+{
+	/* move along the other variable, the current one is fixed,
+	or show the fixed one in the first row and back */
+	Axis t;
+	uint8_t err;
+	if(!calc_y)
+	{
+		return;
+	}
+
+	if(fix)
+	{
+		tbl_fix ^= 1;
+	}
+	else
+	{
+		t = tbl;
+		tbl = tbl_fixed;
+		tbl_fixed = t;
+		tbl_var ^= CHAR_X ^ CHAR_Y;
+		if((err = tbl_fold()))
+		{
+			mode_error(err);
+			return;
+		}
+	}
+
+	mode_table_update();
+}
+#endif
+
+#if CALC_SUM
+static void key_pause(Field *f, uint8_t arg)
+{
+	/* stop and continue */
+	if(!sum_done)
+	{
+		sum_run(!_job);
+	}
+}
+#endif
+
+#if CALC_ITER
+static void key_step(Field *f, uint8_t n)
+{
+	/* u(n + 1) = f(u(n)) for n steps, only the last one is shown.
+	Brent's cycle detection: u is compared with the value saved at
+	the last power of two steps, so a cycle is found within twice
+	its length after it is entered, without storing the values. */
+	num_t v;
+	for(; n && iter_state == ITER_RUN; --n)
+	{
+		if(tbl_solve(iter_u, &v))
+		{
+			iter_state = ITER_ERROR;
+			break;
+		}
+
+		++iter_n;
+		++iter_lam;
+		if(v == iter_save)
+		{
+			iter_state = iter_lam == 1 ? ITER_FIXED : ITER_CYCLE;
+		}
+		else if(fabs(v - iter_u) <= ITER_EPS * fabs(v))
+		{
+			/* Converged, also when it ends up alternating
+			between neighbouring floats */
+			iter_state = ITER_FIXED;
+		}
+		else if(iter_lam == iter_pow)
+		{
+			iter_save = v;
+			iter_pow *= 2;
+			iter_lam = 0;
+		}
+
+		iter_u = v;
+	}
+
+	mode_iter_update();
+}
+#endif
+
+#if CALC_STAT
+static void key_mode(void)
+{
+	/* mode button: statistics, and from there back to input */
+	_job = 0;
+	if(_mode == mode_stat)
+	{
+		mode_input();
+	}
+	else
+	{
+		mode_stat();
+	}
+}
+
+static void key_stat_add(Field *f, uint8_t arg)
+{
+	/* add the sample in the field */
+	mant_t m;
+	int16_t e;
+	uint8_t neg, err, *rest;
+	num_t x;
+	if(!f->len)
+	{
+		return;
+	}
+
+	if((err = num_parse(f->buf, &m, &e, &neg, &rest)))
+	{
+		mode_error(err);
+		return;
+	}
+
+	x = num_scale(m, e, rest);
+	stat_add(neg ? -x : x);
+	field_clear(f);
+	mode_stat_update();
+}
+
+static void key_stat_view(Field *f, uint8_t d)
+{
+	/* previous and next statistic */
+	stat_view = (stat_view + (int8_t)d + STAT_VIEWS) % STAT_VIEWS;
+	mode_stat_update();
+}
+
+static void key_stat_clear(Field *f, uint8_t arg)
+{
+	/* remove all samples */
+	stat_n = 0;
+	stat_mean = 0;
+	stat_m2 = 0;
+	mode_stat_update();
+}
+
+static void key_stat_table(Field *f, uint8_t arg)
+{
+	/* add the rows from 0 to the current one in the
+	background, with the progress shown, see stat_table_job */
+	stat_pos = 0;
+	stat_end = tbl.pos;
+	stat_shown = 0;
+	mode_stat();
+	stat_table_show();
+	_job = stat_table_job;
+}
+#endif
+
+/* Number Parsing */
+static uint8_t num_scan(uint8_t **s, mant_t *m, int16_t *e, uint8_t **rest)
+{
+	/* Accumulate the digits into an integer mantissa and count
+	the decimal exponent, so that only a single float operation
+	is needed per literal. Digits that do not fit into the
+	mantissa are dropped. If one of them is not 0, rest points
+	to the first one, so num_scale can take them into account,
+	otherwise it is 0. */
+	uint8_t *p, *drop, c, dp, digits, sticky;
+	mant_t n;
+	int16_t ex;
+	drop = 0;
+	sticky = 0;
+	for(p = *s, n = 0, ex = 0, dp = 0, digits = 0; (c = *p); ++p)
+	{
+		if(c == CHAR_DP)
+		{
+			if(dp)
+			{
+				return ERROR_SYNTAX;
+			}
+
+			dp = 1;
+		}
+		else if(isdigit(c))
+		{
+			digits = 1;
+			if(n < NUM_MANTISSA_MAX)
+			{
+				n = n * 10 + (c - '0');
+				ex -= dp;
+				continue;
+			}
+
+			if(!drop)
+			{
+				drop = p;
+			}
+
+			sticky |= c != '0';
+			if(!dp)
+			{
+				++ex;
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if(!digits)
+	{
+		/* A lone decimal point is not a number */
+		return ERROR_SYNTAX;
+	}
+
+	*s = p;
+	*m = n;
+	*e = ex;
+	*rest = sticky ? drop : 0;
+	return 0;
+}
+
+static uint8_t num_parse(uint8_t *s, mant_t *m, int16_t *e, uint8_t *neg,
+	uint8_t **rest)
+{
+	/* Parse a whole number field: an optional minus
+	sign followed by a literal and nothing else */
+	if((*neg = (*s == CHAR_SUB)))
+	{
+		++s;
+	}
+
+	if(num_scan(&s, m, e, rest) || *s)
+	{
+		return ERROR_SYNTAX;
+	}
+
+	return 0;
+}
+
+static uint8_t *num_fixed(fixed_t m, uint8_t neg, int16_t e, uint8_t *s,
+	uint8_t width)
+{
+	/* Print m * 10^e, negative with neg, with OUTPUT_PRECISION
+	decimals, right aligned like dtostrf. Used for the table labels
+	and the results of the decimal engine. Returns 0 if the number
+	does not fit width. The digits below the last decimal are dropped
+	and rounded once, half away from zero by the first one of them.
+	Rounding digit by digit would make 0.000149 0.0002. */
+	uint8_t buf[LCD_WIDTH + 1], *p, *r, i, d;
+	int16_t z;
+	for(d = 0; e < -OUTPUT_PRECISION; ++e)
+	{
+		d = m % 10;
+		m /= 10;
+	}
+
+	m += d >= 5;
+
+	/* Number of zeros between the digits and the last decimal */
+	z = e + OUTPUT_PRECISION;
+	p = buf + sizeof(buf);
+	*--p = '\0';
+	for(i = 0; i <= OUTPUT_PRECISION || m || z > 0; ++i)
+	{
+		if(p - buf < 2)
+		{
+			return 0;
+		}
+
+		if(i == OUTPUT_PRECISION)
+		{
+			*--p = CHAR_DP;
+		}
+
+		if(z > 0)
+		{
+			*--p = '0';
+			--z;
+		}
+		else
+		{
+			*--p = '0' + m % 10;
+			m /= 10;
+		}
+	}
+
+	if(neg)
+	{
+		*--p = CHAR_SUB;
+	}
+
+	if(buf + sizeof(buf) - 1 - p > width)
+	{
+		return 0;
+	}
+
+	for(r = s, i = buf + sizeof(buf) - 1 - p; i < width; ++i)
+	{
+		*r++ = ' ';
+	}
+
+	strcpy((char *)r, (char *)p);
+	return s;
+}
+
+static num_t num_scale(mant_t m, int16_t e, const uint8_t *rest)
+{
+	/* m * 10^e followed by the dropped digits at rest, correctly
+	rounded. For mantissas below 2^24 (2^53 for double) and |e| <=
+	NUM_POW10_MAX both operands are exact, so the single
+	multiplication or division rounds correctly. That covers the
+	table rows and most literals, the rest goes through the big
+	integer of num_round. With dropped digits the literal is between
+	m * 10^e and (m + 1) * 10^e. If both round to the same num_t, so
+	does the literal, otherwise the halfway point between the two
+	is in between and num_tie compares the digits with it. */
+	num_t r, r1;
+	if(!rest && m < (mant_t)1 << NUM_BITS &&
+		e >= -NUM_POW10_MAX && e <= NUM_POW10_MAX)
+	{
+		return e < 0 ? (num_t)m / pgm_read_float(&_pow10_P[-e]) :
+			(num_t)m * pgm_read_float(&_pow10_P[e]);
+	}
+
+	r = num_round(m, e, rest != 0);
+	if(rest && (r1 = num_round(m + 1, e, 0)) != r &&
+		num_tie(rest, m, e, r))
+	{
+		return r1;
+	}
+
+	return r;
+}
+
+static num_t num_round(mant_t m, int16_t e, uint8_t sticky)
+{
+	/* m * 10^e = q * 2^-s with an integer q in big, little endian,
+	and sticky set if a division by 10 left a remainder. q is exact
+	for e >= 0. For e < 0, m is shifted left by s bits first, so q
+	keeps at least NUM_BITS + 2 bits after the divisions. Rounding q
+	to NUM_BITS bits, or to the unit of the subnormals, then only
+	needs the bit below them and whether anything below that is
+	set, which is what a float operation would see. The sticky
+	argument stands for digits below m that are not 0. */
+	uint8_t big[NUM_BIG_SIZE], c, i, n;
+	uint16_t s = 0, bits, k, t;
+	int16_t u;
+	mant_t q;
+	if(!m || e < NUM_DEC_MIN)
+	{
+		return 0;
+	}
+
+	if(e > NUM_DEC_MAX)
+	{
+		return INFINITY;
+	}
+
+	if(e < 0)
+	{
+		/* 10/3 is more than log2(10) */
+		s = NUM_BITS + 2 + (-e * 10 + 2) / 3;
+	}
+
+	memset(big, 0, sizeof(big));
+	for(i = s / 8; m; ++i, m >>= 8)
+	{
+		big[i] = m;
+	}
 
-	case KEY_1_0:
-		/* up arrow */
-		--tbl_pos;
-		mode_table_update();
-		break;
+	for(t = 0, i = 0; i < sizeof(big); ++i)
+	{
+		t |= big[i] << (s % 8);
+		big[i] = t;
+		t >>= 8;
+	}
 
-	case KEY_1_1:
-		/* reset */
-		tbl_pos = 0;
-		mode_table_update();
-		break;
+	num_big_pow(big, 10, e > 0 ? e : 0);
 
-	case KEY_1_2:
-		/* down arrow */
-		++tbl_pos;
-		mode_table_update();
-		break;
+	/* Only the bytes up to n can be set while dividing */
+	n = s / 8 + sizeof(mant_t) + 1;
+	for(; e < 0; ++e)
+	{
+		for(t = 0, i = n; i--; )
+		{
+			t = t << 8 | big[i];
+			big[i] = t / 10;
+			t %= 10;
+		}
 
-	case KEY_2_1:
-		/* right arrow */
-		tbl_pos += MODE_TABLE_STEP_BIG;
-		mode_table_update();
-		break;
+		sticky |= t;
+	}
 
-	default:
-		break;
+	/* The unit of the last significand bit is 2^u,
+	the k bits of q below it are dropped */
+	n = sizeof(big);
+	while(!big[n - 1])
+	{
+		--n;
 	}
-}
 
-static void mode_table_update(void)
-{
-	float x, y;
-	x = tbl_start + tbl_pos * tbl_step;
-	y = 0;
+	for(bits = n * 8, c = big[n - 1]; !(c & 0x80); c <<= 1)
+	{
+		--bits;
+	}
 
-	/* Print X */
-	lcd_cursor(2, 0);
-	lcd_string(FORMAT_NUMBER(x, _buf_conv, 14));
+	u = bits - s - NUM_BITS;
+	if(u < NUM_EXP_MIN - NUM_BITS + 1)
+	{
+		u = NUM_EXP_MIN - NUM_BITS + 1;
+	}
 
-	if(calc_solve(x, &y))
+	k = u + s;
+	for(q = 0, t = NUM_BITS; t--; )
 	{
-		/* Do not go into error mode when in table mode, because
-		often functions are undefined for some x values. e.g.
-		f(0) = 1 / x = NaN
-		Print "ERROR" for y instead. */
-		uint8_t i;
-		lcd_cursor(2, 1);
-		for(i = 2; i < LCD_WIDTH - MSG_ERROR_LEN; ++i)
-		{
-			lcd_data(' ');
-		}
+		q = q << 1 | num_big_bit(big, k + t);
+	}
 
-		lcd_string_P(_str_error);
+	for(t = 0; t + 1 < k; ++t)
+	{
+		sticky |= num_big_bit(big, t);
 	}
-	else
+
+	/* Half to even */
+	if(num_big_bit(big, k - 1) && (sticky || (q & 1)))
 	{
-		/* Print Y */
-		lcd_cursor(2, 1);
-		lcd_string(FORMAT_NUMBER(y, _buf_conv, 14));
+		++q;
 	}
+
+	return ldexp(q, u);
 }
 
-/* Settings Mode */
-static void mode_settings(void)
+static uint8_t num_tie(const uint8_t *rest, mant_t m, int16_t e, num_t r)
 {
-	_mode = mode_settings;
-	_event = mode_settings_event;
-	tbl_cur_fld = &fld_start;
+	/* Whether the literal m * 10^e followed by the digits at rest
+	is above the halfway point t = T * 2^V between r and the next
+	num_t, or at t with r odd. d = t / 10^e - m = a / b is in (0, 1]
+	and its decimals are compared with the digits one by one. The
+	sizes of a and b are those of m * 10^e in num_round. */
+	uint8_t a[NUM_BIG_SIZE], b[NUM_BIG_SIZE], c, k, i, j;
+	uint16_t p, w;
+	int u;
+	mant_t q, t;
+	frexp(r, &u);
+	u -= NUM_BITS;
+	if(u < NUM_EXP_MIN - NUM_BITS + 1)
+	{
+		u = NUM_EXP_MIN - NUM_BITS + 1;
+	}
 
-	lcd_clear();
-	lcd_command(LCD_SET_DISPLAY | LCD_DISPLAY_ON |
-		LCD_CURSOR_ON | LCD_BLINKING_OFF);
+	/* r = q * 2^u, T = 2q + 1 and V = u - 1 */
+	q = ldexp(r, -u);
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+	for(i = 0, t = q << 1 | 1; t; ++i, t >>= 8)
+	{
+		a[i] = t;
+	}
 
-	lcd_string_P(_str_start);
-	lcd_string(buf_start);
+	b[0] = 1;
+	num_big_pow(a, 2, u > 1 ? u - 1 : 0);
+	num_big_pow(a, 10, e < 0 ? -e : 0);
+	num_big_pow(b, 2, u < 1 ? 1 - u : 0);
+	num_big_pow(b, 10, e > 0 ? e : 0);
 
-	lcd_cursor(0, 1);
-	lcd_string_P(_str_step);
-	lcd_string(buf_step);
-	field_update(tbl_cur_fld);
-}
+	/* a -= m * b, byte by byte of m, w is the carry */
+	for(j = 0; j < sizeof(mant_t); ++j, m >>= 8)
+	{
+		for(i = 0, w = 0; i + j < sizeof(a); ++i)
+		{
+			p = b[i] * (uint8_t)m + w;
+			w = p >> 8;
+			if(a[i + j] < (uint8_t)p)
+			{
+				++w;
+			}
 
-static void mode_settings_event(uint8_t key)
-{
-	field_number_event(tbl_cur_fld, key);
-	switch(key)
+			a[i + j] -= p;
+		}
+	}
+
+	for(; (c = *rest); ++rest)
 	{
-	case KEY_3_3:
-		/* enter */
-		/* if the start value is invalid, ignore it and just use 0.0 instead */
-		tbl_start = atof((char *)buf_start);
+		if(c == CHAR_DP)
+		{
+			continue;
+		}
 
-		/* step has to be greater than zero */
-		if((tbl_step = atof((char *)buf_step)) == 0.0)
+		if(!isdigit(c))
 		{
-			mode_error(ERROR_RANGE);
 			break;
 		}
 
-		mode_table();
-		break;
+		/* Next decimal k of d by subtracting b */
+		num_big_mul(a, 10);
+		for(k = 0; ; ++k)
+		{
+			i = sizeof(a) - 1;
+			while(i && a[i] == b[i])
+			{
+				--i;
+			}
 
-	case KEY_SHIFT_0_0:
-		/* escape */
-		mode_input();
-		break;
+			if(a[i] < b[i])
+			{
+				break;
+			}
+
+			/* The top bit of p is the borrow */
+			for(i = 0, p = 0; i < sizeof(a); ++i)
+			{
+				p = a[i] - b[i] - (p >> 15);
+				a[i] = p;
+			}
+		}
 
-	case KEY_SHIFT_3_1:
-		/* minus */
-		if(tbl_cur_fld == &fld_start)
+		if(c - '0' != k)
 		{
-			field_ins_chr(tbl_cur_fld, '-');
+			return c - '0' > k;
 		}
-		break;
+	}
 
-	case KEY_SHIFT_1_0:
-		/* up */
-		tbl_cur_fld = &fld_start;
-		field_update(tbl_cur_fld);
-		break;
+	/* The digits end, at t if nothing is left of d */
+	for(i = 0; i < sizeof(a); ++i)
+	{
+		if(a[i])
+		{
+			return 0;
+		}
+	}
 
-	case KEY_SHIFT_1_2:
-		/* down */
-		tbl_cur_fld = &fld_step;
-		field_update(tbl_cur_fld);
-		break;
+	return q & 1;
+}
+
+static uint8_t num_big_bit(const uint8_t *big, uint16_t n)
+{
+	/* Bit n of the big integer of num_round, 0 beyond its end */
+	return n / 8 < NUM_BIG_SIZE ? big[n / 8] >> n % 8 & 1 : 0;
+}
+
+static void num_big_mul(uint8_t *big, uint8_t f)
+{
+	uint16_t t;
+	uint8_t i;
+	for(t = 0, i = 0; i < NUM_BIG_SIZE; ++i)
+	{
+		t += big[i] * f;
+		big[i] = t;
+		t >>= 8;
 	}
 }
 
-/* Error Mode */
-static void mode_error(uint8_t err)
+static void num_big_pow(uint8_t *big, uint8_t f, uint16_t n)
 {
-	lcd_clear();
-	lcd_command(LCD_SET_DISPLAY | LCD_DISPLAY_ON |
-		LCD_CURSOR_OFF | LCD_BLINKING_OFF);
-	lcd_string_P((uint8_t *)pgm_read_word(_err_msg + err - 1));
-	_event = mode_error_event;
-	lcd_cursor(0, 1);
-	lcd_string_P(_str_press_any_key);
+	/* big * f^n */
+	for(; n; --n)
+	{
+		num_big_mul(big, f);
+	}
 }
 
-static void mode_error_event(uint8_t key)
+#if CALC_DOUBLE
+static uint8_t *num_format(num_t v, uint8_t *s, uint8_t width)
 {
-	_mode();
+	/* dtostrf only has float precision, so print the value
+	rounded to OUTPUT_PRECISION decimals digit by digit */
+	uint8_t buf[24], *p, *r, i;
+	uint64_t n;
+	num_t a;
+	if(!((a = fabs(v)) < 1e14))
+	{
+		return (uint8_t *)dtostrf(v, width, OUTPUT_PRECISION, (char *)s);
+	}
+
+	for(i = 0; i < OUTPUT_PRECISION; ++i)
+	{
+		a *= 10;
+	}
+
+	n = (uint64_t)(a + 0.5);
+	p = buf + sizeof(buf);
+	*--p = '\0';
+	for(i = 0; i < OUTPUT_PRECISION || n; ++i)
+	{
+		if(i == OUTPUT_PRECISION)
+		{
+			*--p = CHAR_DP;
+		}
+
+		*--p = '0' + n % 10;
+		n /= 10;
+	}
+
+	if(i == OUTPUT_PRECISION)
+	{
+		*--p = CHAR_DP;
+		*--p = '0';
+	}
+
+	if(v < 0)
+	{
+		*--p = CHAR_SUB;
+	}
+
+	/* Right align like dtostrf */
+	for(r = s, i = buf + sizeof(buf) - 1 - p; i < width; ++i)
+	{
+		*r++ = ' ';
+	}
+
+	strcpy((char *)r, (char *)p);
+	return s;
 }
+#endif
 
 /* Calculation */
 static uint8_t calc_prepare(uint8_t *term)
 {
 	uint8_t c, cur_type, isop, top_stack, top_num;
 	cur_type = TT_NULL;
+#if CALC_DECIMAL
+	calc_exact = 1;
+#endif
+#if CALC_Y2
+	calc_sep = CALC_SEP_NONE;
+#endif
+#if CALC_XY
+	calc_y = 0;
+#endif
 	tok_cnt = 0;
 	top_num = 0;
 	top_stack = 0;
@@ -967,50 +3207,17 @@ static uint8_t calc_prepare(uint8_t *term)
 		isop = 1;
 
 		/* Tokenizer */
-		if(isdigit(c))
+		if(isdigit(c) || c == CHAR_DP)
 		{
 			/* Numbers */
-			uint8_t *begin, dps;
-			float n, power;
-
-			/* Find the end of the float */
-			for(dps = 0, begin = term; (c = *term); ++term)
-			{
-				if(c == CHAR_DP)
-				{
-					if(++dps > 1)
-					{
-						/* Return a syntax error if there
-						is more than one decimal point */
-						return ERROR_SYNTAX;
-					}
-				}
-				else if(!isdigit(c))
-				{
-					/* Break when the end of the number
-					(non digit character) is reached */
-					break;
-				}
-			}
-
-			/* Digits before the decimal point */
-			for(n = 0.0; begin < term; ++begin)
-			{
-				if((c = *begin) == CHAR_DP)
-				{
-					/* Skip the decimal point, if present */
-					++begin;
-					break;
-				}
-
-				n = n * 10.0 + c - '0';
-			}
-
-			/* Digits after the decimal point */
-			for(power = 1.0; begin < term; ++begin)
+			mant_t m;
+			int16_t e;
+			uint8_t *rest;
+			if(num_scan(&term, &m, &e, &rest))
 			{
-				n = n * 10.0 + *begin - '0';
-				power *= 10.0;
+				/* Return a syntax error if there is more
+				than one decimal point or no digit at all */
+				return ERROR_SYNTAX;
 			}
 
 			if(tok_cnt >= TOKEN_LIST_SIZE - 1)
@@ -1019,7 +3226,7 @@ static uint8_t calc_prepare(uint8_t *term)
 			}
 
 			tok_type_list[tok_cnt++] = cur_type = TT_NUMBER;
-			tok_num_list[top_num++] = n / power;
+			tok_num_list[top_num++] = num_scale(m, e, rest);
 			isop = 0;
 		}
 		else
@@ -1042,6 +3249,7 @@ static uint8_t calc_prepare(uint8_t *term)
 
 				case TT_NUMBER:
 				case TT_X:
+				case TT_Y:
 				case TT_RP:
 					cur_type = TT_SUB;
 					break;
@@ -1057,6 +3265,9 @@ static uint8_t calc_prepare(uint8_t *term)
 				tok_type_list[tok_cnt++] =
 					cur_type = TT_NUMBER;
 				tok_num_list[top_num++] = M_PI;
+#if CALC_DECIMAL
+				calc_exact = 0;
+#endif
 				isop = 0;
 				break;
 
@@ -1071,6 +3282,20 @@ static uint8_t calc_prepare(uint8_t *term)
 				isop = 0;
 				break;
 
+#if CALC_XY
+			case CHAR_Y:
+				if(tok_cnt >= TOKEN_LIST_SIZE - 1)
+				{
+					return ERROR_NOMEM;
+				}
+
+				tok_type_list[tok_cnt++] =
+					cur_type = TT_Y;
+				calc_y = 1;
+				isop = 0;
+				break;
+#endif
+
 			/* Parenthesis */
 			case CHAR_LP:
 				/* Push onto the operator stack */
@@ -1132,249 +3357,680 @@ static uint8_t calc_prepare(uint8_t *term)
 				cur_type = TT_DIV;
 				break;
 
-			case CHAR_POW:
-				cur_type = TT_POW;
-				break;
+			case CHAR_POW:
+				cur_type = TT_POW;
+				break;
+
+#if CALC_Y2
+			/* Separator between Y1 and Y2 */
+			case CHAR_SEP:
+				if(calc_sep != CALC_SEP_NONE)
+				{
+					return ERROR_SYNTAX;
+				}
+
+				if((c = calc_pop(top_stack)))
+				{
+					return c;
+				}
+
+				calc_sep = tok_cnt;
+				top_stack = 0;
+				cur_type = TT_NULL;
+				isop = 0;
+				break;
+#endif
+
+			/* Functions are stored as their token type */
+			default:
+				if(IS_FUNC(c))
+				{
+					cur_type = c;
+				}
+			}
+
+			++term;
+		}
+
+		/* RPN converter using the
+		shunting yard algorithm */
+		if(isop)
+		{
+			/* Any operator: Pop all operators from
+			the stack that have a lower precedence */
+			uint8_t precedence, tmp;
+			precedence = get_precedence(cur_type);
+			while(top_stack > 0)
+			{
+				tmp = op_stack[top_stack - 1];
+				if((get_precedence(tmp) > precedence) ||
+					(tmp == TT_LP))
+				{
+					break;
+				}
+
+				--top_stack;
+				if(tok_cnt >= TOKEN_LIST_SIZE - 1)
+				{
+					return ERROR_NOMEM;
+				}
+
+				tok_type_list[tok_cnt++] = tmp;
+			}
+
+			if(top_stack >= OPERATOR_STACK_SIZE - 2)
+			{
+				return ERROR_NOMEM;
+			}
+
+			op_stack[top_stack++] = cur_type;
+			if(IS_FUNC(cur_type))
+			{
+				/* The opening bracket is part of the function */
+				op_stack[top_stack++] = cur_type = TT_LP;
+			}
+		}
+	}
+
+	if((c = calc_pop(top_stack)))
+	{
+		return c;
+	}
+
+	calc_simplify();
+	if((c = calc_convert()))
+	{
+		return c;
+	}
+
+	return calc_check();
+}
+
+static uint8_t calc_pop(uint8_t n)
+{
+	/* Pop all n remaining operators from the stack */
+	while(n > 0)
+	{
+		if(tok_cnt >= TOKEN_LIST_SIZE - 1)
+		{
+			return ERROR_NOMEM;
+		}
+
+		if((tok_type_list[tok_cnt++] = op_stack[--n]) == TT_LP)
+		{
+			/* Missing closing bracket */
+			return ERROR_SYNTAX;
+		}
+	}
+
+	return 0;
+}
+
+static void calc_simplify(void)
+{
+	/* x^0.5 becomes sqrt(x), which is much faster than pow and also
+	defined for 0. The exponent is a number if the token before the
+	power is one. In place, the program only gets shorter. */
+	uint8_t i, n, w, wn, tt;
+	for(i = 0, n = 0, w = 0, wn = 0; i < tok_cnt; ++i)
+	{
+#if CALC_Y2
+		if(i == calc_sep)
+		{
+			calc_sep = w;
+		}
+#endif
+
+		if((tt = tok_type_list[i]) == TT_NUMBER)
+		{
+			tok_num_list[wn++] = tok_num_list[n++];
+		}
+		else if(tt == TT_POW && w && tok_type_list[w - 1] == TT_NUMBER &&
+			tok_num_list[wn - 1] == 0.5)
+		{
+			--w;
+			--wn;
+			tt = TT_SQRT;
+		}
+
+		tok_type_list[w++] = tt;
+	}
+
+	tok_cnt = w;
+}
 
-			/* Logarithm */
-			case 'l':
-				cur_type = TT_LOG;
-				goto add2;
+static uint8_t calc_convert(void)
+{
+	/* The trigonometric functions work in radians. For degrees and
+	grad the argument of sin, cos and tan is multiplied by radians per
+	unit and the result of asin, acos and atan by the inverse, as a
+	number and a multiplication in the program, so calc_solve and the
+	other evaluators need no conversion of their own. Rewritten in
+	place from the end, every token moves by the two inserted for
+	each function before it. */
+	uint8_t i, n, f, w, wn, tt;
+	num_t k[2];
+	if(calc_angle == ANGLE_RAD)
+	{
+		return 0;
+	}
 
-			/* Trigonometric functions */
-			case 'a':
-				switch(*(++term))
-				{
-				case 's':
-					cur_type = TT_ASIN;
-					break;
+	for(i = 0, n = 0, f = 0; i < tok_cnt; ++i)
+	{
+		if((tt = tok_type_list[i]) == TT_NUMBER)
+		{
+			++n;
+		}
+		else if(IS_TRIG(tt) || IS_ATRIG(tt))
+		{
+			++f;
+		}
+	}
 
-				case 'c':
-					cur_type = TT_ACOS;
-					break;
+	if(!f)
+	{
+		return 0;
+	}
 
-				case 't':
-					cur_type = TT_ATAN;
-					break;
-				}
+	if(tok_cnt + 2 * f >= TOKEN_LIST_SIZE)
+	{
+		return ERROR_NOMEM;
+	}
 
-				goto add2;
+	memcpy_P(k, _angle_k_P[calc_angle], sizeof(k));
+	w = tok_cnt + 2 * f;
+	wn = n + f;
+	for(i = tok_cnt; i--;)
+	{
+		tt = tok_type_list[i];
+		if(IS_ATRIG(tt))
+		{
+			tok_type_list[--w] = TT_MUL;
+			tok_type_list[--w] = TT_NUMBER;
+			tok_num_list[--wn] = k[1];
+		}
 
-			case 's':
-				cur_type = TT_SIN;
-				goto add2;
+		tok_type_list[--w] = tt;
+		if(tt == TT_NUMBER)
+		{
+			tok_num_list[--wn] = tok_num_list[--n];
+		}
+		else if(IS_TRIG(tt))
+		{
+			tok_type_list[--w] = TT_MUL;
+			tok_type_list[--w] = TT_NUMBER;
+			tok_num_list[--wn] = k[0];
+		}
 
-			case 'c':
-				cur_type = TT_COS;
-				goto add2;
+#if CALC_Y2
+		if(i == calc_sep)
+		{
+			calc_sep = w;
+		}
+#endif
+	}
 
-			case 't':
-				cur_type = TT_TAN;
+	tok_cnt += 2 * f;
+	return 0;
+}
 
-			add2:
-				term += 2;
+static uint8_t calc_check(void)
+{
+	/* Verify the operand count of every operator and the maximum
+	stack depth once, so calc_solve can run without any checks */
+	uint8_t i, tt, depth, base = 0;
+	calc_depth = 0;
+	for(i = 0, depth = 0; i < tok_cnt; ++i)
+	{
+#if CALC_Y2
+		if(i == calc_sep)
+		{
+			/* Y1 is complete, Y2 must not use its result */
+			if(depth != 1)
+			{
+				return ERROR_SYNTAX;
 			}
 
-			++term;
+			base = 1;
 		}
+#endif
 
-		/* RPN converter using the
-		shunting yard algorithm */
-		if(isop)
+		if((tt = tok_type_list[i]) < TT_UNARY_MINUS)
 		{
-			/* Any operator: Pop all operators from
-			the stack that have a lower precedence */
-			uint8_t precedence, tmp;
-			precedence = get_precedence(cur_type);
-			while(top_stack > 0)
+			if(++depth > NUMBER_STACK_SIZE)
 			{
-				tmp = op_stack[top_stack - 1];
-				if((get_precedence(tmp) > precedence) ||
-					(tmp == TT_LP))
-				{
-					break;
-				}
-
-				--top_stack;
-				if(tok_cnt >= TOKEN_LIST_SIZE - 1)
-				{
-					return ERROR_NOMEM;
-				}
-
-				tok_type_list[tok_cnt++] = tmp;
+				return ERROR_NOMEM;
 			}
 
-			if(top_stack >= OPERATOR_STACK_SIZE - 1)
+			if(depth > calc_depth)
 			{
-				return ERROR_NOMEM;
+				calc_depth = depth;
+			}
+		}
+		else if(tt >= TT_ADD)
+		{
+			if(depth < base + 2)
+			{
+				return ERROR_SYNTAX;
 			}
 
-			op_stack[top_stack++] = cur_type;
+			--depth;
+		}
+		else if(depth == base)
+		{
+			return ERROR_SYNTAX;
+		}
+
+#if CALC_DECIMAL
+		/* The decimal engine only knows literals and the
+		four basic operations, and has a smaller stack */
+		if(tt == TT_X || tt == TT_Y || tt == TT_POW ||
+			(tt > TT_UNARY_MINUS && tt < TT_ADD) ||
+			depth > DEC_STACK_SIZE)
+		{
+			calc_exact = 0;
 		}
+#endif
 	}
 
-	/* Pop all remaining operators from the stack */
-	while(top_stack > 0)
+#if CALC_Y2
+	if(calc_sep != CALC_SEP_NONE)
 	{
-		if(tok_cnt >= TOKEN_LIST_SIZE - 1)
+		/* Y2 must not be empty */
+		base = 1;
+		if(calc_sep == tok_cnt)
 		{
-			return ERROR_NOMEM;
+			return ERROR_SYNTAX;
 		}
+	}
+#endif
+
+	if(depth != base + 1)
+	{
+		return ERROR_SYNTAX;
+	}
 
-		tok_type_list[tok_cnt++] =
-			op_stack[--top_stack];
+#if CALC_CACHE_SIZE
+	for(i = 0; i < CALC_CACHE_SIZE; ++i)
+	{
+		calc_cache[i].err = CALC_CACHE_EMPTY;
 	}
+#endif
 
+#if CALC_IR
+	calc_lower();
+#endif
 	return 0;
 }
 
-static uint8_t calc_solve(float x, float *y)
+#if CALC_IR
+static void calc_lower(void)
+{
+	/* Translate the verified RPN program into instructions with
+	three operands. Numbers and x are not pushed, an operand refers
+	to them directly. The result of an operator goes to the
+	num_stack slot of the stack machine at the same depth, which is
+	the register allocation by liveness for a tree: a slot is free
+	again as soon as its value has been used. */
+	const num_t *opd[NUMBER_STACK_SIZE];
+	IrIns *ins = calc_ir;
+	uint8_t i, n, depth, tt;
+	for(i = 0, n = 0, depth = 0; i < tok_cnt; ++i)
+	{
+#if CALC_Y2
+		if(i == calc_sep)
+		{
+			calc_ir_end[0] = ins - calc_ir;
+			calc_ir_res[0] = opd[0];
+		}
+#endif
+
+		if((tt = tok_type_list[i]) == TT_NUMBER)
+		{
+			opd[depth++] = &tok_num_list[n++];
+		}
+		else if(tt < TT_UNARY_MINUS)
+		{
+			opd[depth++] = &calc_ir_x;
+		}
+		else
+		{
+			ins->op = tt;
+			ins->b = tt >= TT_ADD ? opd[--depth] : opd[depth - 1];
+			ins->a = opd[depth - 1];
+			opd[depth - 1] = ins->d = &num_stack[depth - 1];
+			++ins;
+		}
+	}
+
+	/* Without Y2, both ends are the same */
+	calc_ir_end[CALC_FUNCS - 1] = ins - calc_ir;
+	calc_ir_res[CALC_FUNCS - 1] = opd[depth - 1];
+#if CALC_Y2
+	if(calc_sep == CALC_SEP_NONE)
+	{
+		calc_ir_end[0] = ins - calc_ir;
+		calc_ir_res[0] = opd[0];
+	}
+#endif
+}
+#endif
+
+static uint8_t calc_solve(num_t x, num_t *y)
 {
-	float op_left, op_right;
-	uint8_t tok_type_i, tok_num_i, top_num;
+	/* The program has been verified by calc_check,
+	so there are no stack checks in here. With a second
+	function y[1] is the result of Y2, from the same pass. */
+#if CALC_IR
+	const IrIns *ins;
+	uint8_t f;
+#else
+	num_t op_left, op_right;
+	uint8_t tok_type_i, tok_num_i, top_num, tt;
+#endif
+	uint8_t err;
+#if CALC_Y2
+	uint8_t fail = 0;
+#endif
+#if CALC_CACHE_SIZE
+	CacheEntry *ce;
+	union { num_t n; uint8_t b[sizeof(num_t)]; } key;
+	uint8_t h, k;
+	key.n = x;
+	for(k = 0, h = 0; k < sizeof(num_t); ++k)
+	{
+		h = (h << 1 | h >> 7) ^ key.b[k];
+	}
+
+	ce = &calc_cache[h & (CALC_CACHE_SIZE - 1)];
+
+	if(ce->err != CALC_CACHE_EMPTY && ce->x == x)
+	{
+		memcpy(y, ce->y, sizeof(ce->y));
+		return ce->err;
+	}
+
+	ce->x = x;
+	ce->err = ERROR_MATH;
+#endif
+
+#if CALC_IR
+	/* Every instruction reads its operands from their registers
+	and writes its result, numbers and x are never copied */
+	calc_ir_x = x;
+	for(f = 0, ins = calc_ir; f < CALC_FUNCS; ++f)
+	{
+		for(; ins < calc_ir + calc_ir_end[f]; ++ins)
+		{
+			if(calc_op(ins->op, ins->d, *ins->a, *ins->b))
+			{
+#if CALC_Y2
+				fail |= 1 << f;
+#else
+				return ERROR_MATH;
+#endif
+			}
+		}
+
+		y[f] = *calc_ir_res[f];
+	}
+#else
 	tok_type_i = 0;
 	tok_num_i = 0;
 	top_num = 0;
 	for(; tok_type_i < tok_cnt; ++tok_type_i)
 	{
-		switch(tok_type_list[tok_type_i])
+		switch((tt = tok_type_list[tok_type_i]))
 		{
 		case TT_NUMBER:
-			if(top_num >= NUMBER_STACK_SIZE - 1)
-			{
-				return ERROR_NOMEM;
-			}
-
 			num_stack[top_num++] =
 				tok_num_list[tok_num_i++];
 			break;
 
 		case TT_X:
-			if(top_num >= NUMBER_STACK_SIZE - 1)
-			{
-				return ERROR_NOMEM;
-			}
-
+		case TT_Y:
+			/* Like in calc_lower, calc_fold has replaced y before
+			a term with y is evaluated in table mode */
 			num_stack[top_num++] = x;
 			break;
 
 		default:
-			op_right = 0;
-			if(tok_type_list[tok_type_i] < TT_ADD)
-			{
-				if(top_num == 0)
-				{
-					/* Buffer underflow */
-					return ERROR_SYNTAX;
-				}
-			}
-			else
+			if(tt >= TT_ADD)
 			{
-				if(top_num <= 1)
-				{
-					/* Buffer underflow */
-					return ERROR_SYNTAX;
-				}
-
 				op_right = num_stack[--top_num];
 			}
 
-			op_left = num_stack[--top_num];
-			switch(tok_type_list[tok_type_i])
+			op_left = num_stack[top_num - 1];
+			if(calc_op(tt, &num_stack[top_num - 1], op_left, op_right))
 			{
-			case TT_UNARY_MINUS:
-				op_left = -op_left;
-				break;
+				CALC_DOMAIN_ERROR(tok_type_i);
+			}
+			break;
+		}
+	}
 
-			case TT_ADD:
-				op_left += op_right;
-				break;
+	y[0] = num_stack[0];
+#if CALC_Y2
+	y[1] = num_stack[1];
+#endif
+#endif
 
-			case TT_SUB:
-				op_left -= op_right;
-				break;
+	/* Domain errors that are not caught above end
+	up as NaN or infinity, e.g. log(-1) or 10^99 */
+#if CALC_Y2
+	if(fail & 2)
+	{
+		y[1] = NAN;
+	}
 
-			case TT_MUL:
-				op_left *= op_right;
-				break;
+	if(fail & 1)
+	{
+		y[0] = NAN;
+	}
+#endif
 
-			case TT_DIV:
-				if(op_right == 0.0)
-				{
-					/* Division by zero */
-					return ERROR_MATH;
-				}
+	err = isfinite(y[0]) ? 0 : ERROR_MATH;
 
-				op_left /= op_right;
-				break;
+#if CALC_CACHE_SIZE
+	memcpy(ce->y, y, sizeof(ce->y));
+	ce->err = err;
+#endif
 
-			case TT_LOG:
-				op_left = log(op_left);
-				break;
+	return err;
+}
 
-			case TT_SIN:
-				op_left = SIND(op_left);
-				break;
+static uint8_t calc_op(uint8_t tt, num_t *r, num_t a, num_t b)
+{
+	/* One operation of calc_solve, r = a tt b or r = tt(a).
+	Returns 1 for a domain error without writing r. Also folds
+	the constant subtrees in calc_fold. */
+	switch(tt)
+	{
+	case TT_UNARY_MINUS:
+		a = -a;
+		break;
 
-			case TT_COS:
-				op_left = COSD(op_left);
-				break;
+	case TT_ADD:
+		a += b;
+		break;
 
-			case TT_TAN:
-				op_left = TAND(op_left);
-				break;
+	case TT_SUB:
+		a -= b;
+		break;
 
-			case TT_ASIN:
-				if(!asin_acos_range(op_left))
-				{
-					return ERROR_MATH;
-				}
-				op_left = ASIND(op_left);
-				break;
+	case TT_MUL:
+		a *= b;
+		break;
 
-			case TT_ACOS:
-				if(!asin_acos_range(op_left))
-				{
-					return ERROR_MATH;
-				}
-				op_left = ACOSD(op_left);
-				break;
+	case TT_DIV:
+#if !CALC_FAST_MATH
+		if(b == 0.0)
+		{
+			/* Division by zero */
+			return 1;
+		}
+#endif
 
-			case TT_ATAN:
-				op_left = ATAND(op_left);
-				break;
+		a /= b;
+		break;
 
-			case TT_POW:
-				op_left = pow(op_left, op_right);
-				break;
+	case TT_LOG:
+		a = log(a);
+		break;
 
-			default:
-				continue;
+	case TT_SIN:
+		a = sin(a);
+		break;
+
+	case TT_COS:
+		a = cos(a);
+		break;
+
+	case TT_TAN:
+		a = tan(a);
+		break;
+
+	case TT_ASIN:
+#if !CALC_FAST_MATH
+		if(!asin_acos_range(a))
+		{
+			return 1;
+		}
+#endif
+
+		a = asin(a);
+		break;
+
+	case TT_ACOS:
+#if !CALC_FAST_MATH
+		if(!asin_acos_range(a))
+		{
+			return 1;
+		}
+#endif
+
+		a = acos(a);
+		break;
+
+	case TT_ATAN:
+		a = atan(a);
+		break;
+
+	case TT_SQRT:
+#if !CALC_FAST_MATH
+		if(a < 0)
+		{
+			return 1;
+		}
+#endif
+
+		a = sqrt(a);
+		break;
+
+	case TT_EXP:
+		a = exp(a);
+		break;
+
+	case TT_POW:
+		a = pow(a, b);
+		break;
+	}
+
+	*r = a;
+	return 0;
+}
+
+#if CALC_DECIMAL
+static uint8_t dec_solve(uint8_t *term, uint8_t *s, uint8_t width)
+{
+	/* Exact evaluation of a program that calc_check marked with
+	calc_exact. The literals are scanned from the term again
+	instead of being stored, they appear in the same order in
+	the RPN program as in the term. A literal with more digits
+	than the engine holds is not exact, so the term is left to
+	num_t. */
+	Decimal stack[DEC_STACK_SIZE], *a;
+	uint8_t i, top, tt, *rest;
+	mant_t m;
+	int16_t e;
+	for(i = 0, top = 0; i < tok_cnt; ++i)
+	{
+		if((tt = tok_type_list[i]) == TT_NUMBER)
+		{
+			while(!isdigit(*term) && *term != CHAR_DP)
+			{
+				++term;
 			}
 
-			if(top_num >= NUMBER_STACK_SIZE - 1)
+			num_scan(&term, &m, &e, &rest);
+			while(m >= DEC_MAX && m % 10 == 0)
 			{
-				return ERROR_NOMEM;
+				m /= 10;
+				++e;
+			}
+
+			if(rest || m >= DEC_MAX)
+			{
+				return ERROR_RANGE;
+			}
+
+			stack[top].m = m;
+			stack[top++].e = e;
+			continue;
+		}
+
+		a = &stack[top - 1];
+		if(tt == TT_UNARY_MINUS)
+		{
+			a->m = -a->m;
+			continue;
+		}
+
+		--a;
+		--top;
+		switch(tt)
+		{
+		case TT_SUB:
+			a[1].m = -a[1].m;
+			/* fall through */
+
+		case TT_ADD:
+			tt = dec_add(a, a + 1);
+			break;
+
+		case TT_MUL:
+			tt = dec_mul(a, a + 1);
+			break;
+
+		case TT_DIV:
+			if(a[1].m == 0)
+			{
+				/* Division by zero */
+				return ERROR_MATH;
 			}
 
-			num_stack[top_num++] = op_left;
+			tt = dec_div(a, a + 1);
 			break;
 		}
-	}
 
-	if(top_num != 1)
-	{
-		return ERROR_SYNTAX;
+		if(!tt)
+		{
+			return ERROR_RANGE;
+		}
 	}
 
-	*y = num_stack[--top_num];
-	return 0;
+	a = stack;
+	return num_fixed(a->m < 0 ? -a->m : a->m, a->m < 0, a->e, s, width) ?
+		0 : ERROR_RANGE;
 }
+#endif
 
-static uint8_t asin_acos_range(float n)
+#if !CALC_FAST_MATH
+static uint8_t asin_acos_range(num_t n)
 {
 	return n >= -1 && n <= 1;
 }
+#endif
 
 static uint8_t get_precedence(uint8_t tt)
 {
@@ -1396,12 +4052,29 @@ static uint8_t get_precedence(uint8_t tt)
 }
 
 /* Key Scanning Interrupt */
+static void key_put(uint8_t key)
+{
+	/* Handled by the main loop, a key
+	is dropped if the queue is full */
+	uint8_t h = (key_head + 1) & (KEY_QUEUE_SIZE - 1);
+	if(h != key_tail)
+	{
+		key_queue[key_head] = key;
+		key_head = h;
+	}
+}
+
 ISR(TIMER2_COMPA_vect)
 {
 	static int8_t last_key = KEY_NULL;
+	static uint8_t last_shift = 0, shift_used = 0;
+#if CALC_STAT
+	static uint8_t last_mode = 0;
+#endif
 	static uint8_t t = 0, lt = 3;
 	static uint16_t key_states = 0;
 
+	++ticks;
 	key_states |= (PINC & 0x0F) << (4 * lt);
 	DDRB &= ~(1 << lt);
 	PORTB &= ~(1 << lt);
@@ -1437,10 +4110,38 @@ ISR(TIMER2_COMPA_vect)
 		t = 0;
 		if(key != last_key && last_key == KEY_NULL)
 		{
-			_event((uint8_t)key);
+			key_put(key);
 		}
 
 		last_key = key;
+
+		/* Shift on its own, once per press */
+		if(!((PINB >> PIN_SHIFT) & 1))
+		{
+			shift_used |= key != KEY_NULL;
+			last_shift = 1;
+		}
+		else
+		{
+			if(last_shift && !shift_used)
+			{
+				key_put(KEY_ALT);
+			}
+
+			last_shift = 0;
+			shift_used = 0;
+		}
+
+#if CALC_STAT
+		/* Mode button, once per press */
+		key = !((PINB >> PIN_MODE) & 1);
+		if(key && !last_mode)
+		{
+			key_put(KEY_MODE);
+		}
+
+		last_mode = key;
+#endif
 	}
 }
 
@@ -0,0 +1,85 @@
+/* Partial evaluation of the RPN program for a term with x and y.
+In table mode one variable is moved and the other one stays at the
+value of its row. Every subtree that does not depend on the moved
+variable is replaced by its value once, and the moved variable becomes
+TT_X, so calc_solve, calc_solve_dual and calc_solve_interval only
+evaluate the part that depends on it, like for a term with x only.
+This also folds subtrees of constants, e.g. sin(30) with the
+conversion of its degrees. */
+
+static uint8_t calc_fold(uint8_t var, num_t v);
+
+static uint8_t calc_fold(uint8_t var, num_t v)
+{
+	/* In place, the program only gets shorter. The other variable
+	becomes a number though, so the numbers are moved to the end of
+	their list first and read from there. */
+	uint8_t i, n, w, wn, tt, k;
+	num_t r;
+	for(i = 0, n = 0; i < tok_cnt; ++i)
+	{
+		if(tok_type_list[i] == TT_NUMBER)
+		{
+			++n;
+		}
+	}
+
+	memmove(tok_num_list + TOKEN_LIST_SIZE - n, tok_num_list,
+		n * sizeof(num_t));
+	n = TOKEN_LIST_SIZE - n;
+	var = var == CHAR_Y ? TT_Y : TT_X;
+	for(i = 0, w = 0, wn = 0; i < tok_cnt; ++i)
+	{
+#if CALC_Y2
+		if(i == calc_sep)
+		{
+			calc_sep = w;
+		}
+#endif
+
+		switch((tt = tok_type_list[i]))
+		{
+		case TT_NUMBER:
+			tok_num_list[wn++] = tok_num_list[n++];
+			break;
+
+		case TT_X:
+		case TT_Y:
+			if(tt == var)
+			{
+				tt = TT_X;
+			}
+			else
+			{
+				tok_num_list[wn++] = v;
+				tt = TT_NUMBER;
+			}
+			break;
+
+		default:
+			/* The value of an operator on numbers, a subtree is a
+			number only if it ends with one. Not if it is undefined
+			for them, calc_solve reports that for every row. */
+			k = tt >= TT_ADD ? 2 : 1;
+			if(tok_type_list[w - 1] != TT_NUMBER ||
+				(k == 2 && tok_type_list[w - 2] != TT_NUMBER) ||
+				calc_op(tt, &r, tok_num_list[wn - k],
+				tok_num_list[wn - 1]) || !isfinite(r))
+			{
+				break;
+			}
+
+			/* The result replaces the operands */
+			tok_num_list[wn - k] = r;
+			w -= k - 1;
+			wn -= k - 1;
+			continue;
+		}
+
+		tok_type_list[w++] = tt;
+	}
+
+	/* Depth and cache */
+	tok_cnt = w;
+	return calc_check();
+}
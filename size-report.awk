@@ -0,0 +1,102 @@
+# Flash and RAM usage breakdown from the linker map file.
+#
+# Usage: awk -v flash_budget=N -v ram_budget=N -f size-report.awk main.map
+#
+# Sums the input sections of .text, .data, .bss and .noinit by the
+# archive (libm, libgcc, libc) or object file they come from, prints
+# the totals and exits with status 1 if a budget is exceeded.
+
+function hex(s,    i, n)
+{
+	n = 0
+	s = tolower(s)
+	sub(/^0x/, "", s)
+	for(i = 1; i <= length(s); ++i)
+	{
+		n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+	}
+
+	return n
+}
+
+function group(file)
+{
+	if(file ~ /libm\.a\(/) return "libm"
+	if(file ~ /libgcc\.a\(/) return "libgcc"
+	if(file ~ /libc\.a\(/) return "libc"
+	if(file ~ /crt[^\/]*\.o$/) return "crt"
+	if(file ~ /ltrans/) return "application (lto)"
+	sub(/.*\//, "", file)
+	return file
+}
+
+function add(size, file,    g)
+{
+	if(out == "" || size == 0) return
+	g = group(file)
+	usage[out, g] += size
+	groups[g] = 1
+}
+
+# Output sections start in the first column
+/^\.[a-z]/ {
+	out = ""
+	if($1 == ".text" || $1 == ".data" || $1 == ".bss" || $1 == ".noinit")
+	{
+		out = $1
+		if(NF >= 3) total[out] = hex($3)
+	}
+	pending = 0
+	next
+}
+
+# Input section on one line: " .name 0xaddr 0xsize file"
+/^ \.[^ ]+ +0x[0-9a-f]+ +0x[0-9a-f]+ / {
+	add(hex($3), $4)
+	pending = 0
+	next
+}
+
+# Input section name too long, address and size follow on the next line
+/^ \.[^ ]+$/ {
+	pending = 1
+	next
+}
+
+pending && /^ +0x[0-9a-f]+ +0x[0-9a-f]+ / {
+	add(hex($2), $3)
+	pending = 0
+	next
+}
+
+{ pending = 0 }
+
+END {
+	flash = total[".text"] + total[".data"]
+	ram = total[".data"] + total[".bss"] + total[".noinit"]
+
+	printf "%-20s %8s %8s %8s %8s\n", "", ".text", ".data", ".bss", ".noinit"
+	for(g in groups)
+	{
+		printf "%-20s %8d %8d %8d %8d\n", g, usage[".text", g],
+			usage[".data", g], usage[".bss", g], usage[".noinit", g]
+	}
+
+	printf "\nFlash: %6d / %6d bytes\n", flash, flash_budget
+	printf "RAM:   %6d / %6d bytes\n", ram, ram_budget
+
+	status = 0
+	if(flash_budget && flash > flash_budget)
+	{
+		print "Flash budget exceeded by " (flash - flash_budget) " bytes"
+		status = 1
+	}
+
+	if(ram_budget && ram > ram_budget)
+	{
+		print "RAM budget exceeded by " (ram - ram_budget) " bytes"
+		status = 1
+	}
+
+	exit status
+}